@@ -11,15 +11,23 @@
 
 #include "core/Instance.h"
 
-PARAM(open_scene);
+#include "mcube/Benchmark.h"
+#include "threading/JobBenchmark.h"
 
-#define DEFAULT_START_CHUNKS_PER_AXIS 3
-PARAM(start_chunks_per_axis);
+PARAM(open_scene);
 
 #define DEFAULT_USE_MULTITHREADING false
 bool g_useMultithreading{ DEFAULT_USE_MULTITHREADING };
 PARAM(use_multithreading);
 
+#define DEFAULT_MESH_BENCHMARK_ITERATIONS 5
+PARAM(mesh_benchmark);
+PARAM(mesh_benchmark_iterations);
+
+#define DEFAULT_JOB_BENCHMARK_JOBS 100000
+PARAM(job_benchmark);
+PARAM(job_benchmark_jobs);
+
 MCubeEditorApp::MCubeEditorApp() :
     WindowedApplication()
 { }
@@ -42,6 +50,21 @@ void MCubeEditorApp::on_app_startup()
     }
 
     JobDispatch::initialize();
+
+    if( Param_mesh_benchmark.get() )
+    {
+        int iterations{ DEFAULT_MESH_BENCHMARK_ITERATIONS };
+        Param_mesh_benchmark_iterations.get_int(&iterations);
+        mcube::run_benchmark({ 16, 64, 256 }, static_cast<uint32_t>(std::max(iterations, 1)));
+    }
+
+    if( Param_job_benchmark.get() )
+    {
+        int jobs{ DEFAULT_JOB_BENCHMARK_JOBS };
+        Param_job_benchmark_jobs.get_int(&jobs);
+        run_job_benchmark({ 1, 2, 4, 8, 16, 32 }, static_cast<uint32_t>(std::max(jobs, 1)));
+    }
+
     initialize_scene();
 
     m_renderer = std::make_unique<Renderer>(get_render_context());
@@ -74,15 +97,11 @@ void MCubeEditorApp::update(double deltaTime)
 
     if( g_useMultithreading )
     {
-        std::function<void()> updateFunc = std::bind(&MCubeEditorApp::update_scene, this, deltaTime);
-        std::function<void()> renderFunc = std::bind(&MCubeEditorApp::render_scene, this);
-
-        std::atomic<uint32_t>* updateJob = JobDispatch::execute(updateFunc);
-        std::atomic<uint32_t>* renderJob = JobDispatch::execute(renderFunc);
+        JobHandle updateJob = JobDispatch::execute([this, deltaTime]{ update_scene(deltaTime); });
+        JobHandle renderJob = JobDispatch::execute([this]{ render_scene(); });
 
-        while( (*updateJob).load() != 0 || (*renderJob).load() != 0 )
-        { }
-        JobDispatch::reset_counters();
+        JobDispatch::wait(updateJob);
+        JobDispatch::wait(renderJob);
     }
     else
     {
@@ -131,28 +150,13 @@ void MCubeEditorApp::initialize_scene()
     m_scene->request_create_blueprint(std::move(cursor));
     m_scene->request_create_entity(std::move(cursorEnt));
 
-    int beginChunksPerAxis{ 0 };
-    if( !Param_start_chunks_per_axis.get_int(&beginChunksPerAxis) )
-    {
-        beginChunksPerAxis = DEFAULT_START_CHUNKS_PER_AXIS;
-    }
-    beginChunksPerAxis = std::max(beginChunksPerAxis, 1);
-    m_chunksPerAxis = beginChunksPerAxis;
+    m_chunkGrid = std::make_unique<ChunkGrid>(m_scene.get(), glm::vec3{ 10.f, 10.f, 10.f });
 
-    glm::ivec3 offset{ m_chunksPerAxis / 2, m_chunksPerAxis / 2, m_chunksPerAxis / 2 };
-
-    for( int x = 0; x < beginChunksPerAxis; x++ )
-    {
-        for( int y = 0; y < beginChunksPerAxis; y++ )
-        {
-            for( int z = 0; z < beginChunksPerAxis; z++ )
-            {
-                // idc about trying to centre around 0,0,0 lol
-                glm::ivec3 chunkIndex{ x, y, z };
-                create_chunk(chunkIndex - offset);
-            }
-        }
-    }
+    // Chunks paged out of an unsaved scene go to a scratch directory of this run.
+    const char* openScene = Param_open_scene.value();
+    m_chunkStreamer = openScene
+        ? std::make_unique<ChunkStreamer>(m_chunkGrid.get(), openScene)
+        : std::make_unique<ChunkStreamer>(m_chunkGrid.get());
 }
 
 void MCubeEditorApp::parse_input(double deltaTime)
@@ -215,6 +219,29 @@ void MCubeEditorApp::parse_input(double deltaTime)
 
     m_cursorScale += 0.1f * static_cast<float>(Input::get_mouse_scroll_vertical());
     m_cursorScale = std::clamp(m_cursorScale, 0.1f, 50.f);
+
+    // Brush selection
+    if( Input::get_key_pressed(KeyCode::_1) )
+        m_brushShape = mcube::BrushShape::SPHERE;
+    if( Input::get_key_pressed(KeyCode::_2) )
+        m_brushShape = mcube::BrushShape::BOX;
+    if( Input::get_key_pressed(KeyCode::_3) )
+        m_brushShape = mcube::BrushShape::CAPSULE;
+    if( Input::get_key_pressed(KeyCode::_4) )
+        m_brushShape = mcube::BrushShape::CYLINDER;
+
+    if( Input::get_key_pressed(KeyCode::_5) )
+        m_brushOperation = mcube::BrushOperation::ADD;
+    if( Input::get_key_pressed(KeyCode::_6) )
+        m_brushOperation = mcube::BrushOperation::SMOOTH_UNION;
+    if( Input::get_key_pressed(KeyCode::_7) )
+        m_brushOperation = mcube::BrushOperation::SMOOTH_SUBTRACT;
+    if( Input::get_key_pressed(KeyCode::_8) )
+        m_brushOperation = mcube::BrushOperation::SMOOTH_INTERSECT;
+    if( Input::get_key_pressed(KeyCode::_9) )
+        m_brushOperation = mcube::BrushOperation::BLUR;
+    if( Input::get_key_pressed(KeyCode::_0) )
+        m_brushOperation = mcube::BrushOperation::FLATTEN;
 }
 
 void MCubeEditorApp::update_scene(double deltaTime)
@@ -229,31 +256,64 @@ void MCubeEditorApp::update_scene(double deltaTime)
 
     if( Input::get_mouse_button_down(0) )
     {
-        for( auto& chunk : m_chunks )
+        bool invert = Input::get_key_down(KeyCode::LeftControl);
+        float rate = static_cast<float>(deltaTime) * 10.f;
+
+        mcube::Brush brush;
+        brush.shape = m_brushShape;
+        brush.operation = m_brushOperation;
+        brush.position = get_cursor_position();
+        brush.extents = glm::vec3(m_cursorScale);
+        brush.smoothness = m_cursorScale * 0.5f;
+
+        switch( m_brushOperation )
         {
-            chunk.second->sphere_edit(get_cursor_position(), m_cursorScale, static_cast<float>(deltaTime), !Input::get_key_down(KeyCode::LeftControl));
+        case mcube::BrushOperation::ADD:
+            brush.strength = invert ? -rate : rate;
+            break;
+        case mcube::BrushOperation::SMOOTH_UNION:
+        case mcube::BrushOperation::SMOOTH_SUBTRACT:
+            if( invert )
+            {
+                brush.operation = m_brushOperation == mcube::BrushOperation::SMOOTH_UNION
+                    ? mcube::BrushOperation::SMOOTH_SUBTRACT
+                    : mcube::BrushOperation::SMOOTH_UNION;
+            }
+            brush.strength = std::min(rate, 1.f);
+            break;
+        default:
+            brush.strength = std::min(rate, 1.f);
+            break;
         }
+
+        queue_brush(brush);
     }
+
+    m_chunkStreamer->update(m_camera->get_position());
+    apply_queued_brushes();
+    m_chunkGrid->update(*m_camera);
 }
 
-void MCubeEditorApp::render_scene()
+void MCubeEditorApp::queue_brush(const mcube::Brush& brush)
 {
-    uint32_t renderFinished;
-    m_renderer->dispatch_render({ m_scene->get_blueprint_proxies(), m_scene->get_entity_proxies() }, { m_camera.get() }, &renderFinished);
+    m_queuedBrushes.push_back(brush);
 }
 
-void MCubeEditorApp::create_chunk(glm::ivec3 index)
+void MCubeEditorApp::apply_queued_brushes()
 {
-    if( m_chunks.find(index) != m_chunks.end() )
+    if( m_queuedBrushes.empty() )
     {
         return;
     }
 
-    glm::vec3 size{ 10.f, 10.f, 10.f };
-    glm::vec3 origin{ index.x * size.x, index.y * size.y, index.z * size.z };
+    m_chunkGrid->apply_brushes(m_queuedBrushes);
+    m_queuedBrushes.clear();
+}
 
-    m_chunks.insert(std::pair(index,
-        std::make_unique<Chunk>(m_scene.get(), std::format("chunk:{}-{}-{}", index.x, index.y, index.z), origin, size)));
+void MCubeEditorApp::render_scene()
+{
+    uint32_t renderFinished;
+    m_renderer->dispatch_render({ m_scene->get_blueprint_proxies(), m_scene->get_entity_proxies() }, { m_camera.get() }, &renderFinished);
 }
 
 glm::vec3 MCubeEditorApp::get_cursor_position() const
@@ -6,7 +6,8 @@
 #include "scene/gameplay/Camera.h"
 #include "scene/Scene.h"
 #include "scene/rendering/Renderer.h"
-#include "scene/Chunk.h"
+#include "scene/ChunkGrid.h"
+#include "scene/ChunkStreamer.h"
 #include "threading/JobDispatcher.h"
 // #include "scene/Scene.h"
 
@@ -33,9 +34,11 @@ private:
     void parse_input(double deltaTime);
 
     void update_scene(double deltaTime);
-    void render_scene();
 
-    void create_chunk(glm::ivec3 index);
+    // Edits are queued during the frame and applied to every chunk in one batch.
+    void queue_brush(const mcube::Brush& brush);
+    void apply_queued_brushes();
+    void render_scene();
 
     glm::vec3 get_cursor_position() const;
 private:
@@ -43,9 +46,14 @@ private:
     std::unique_ptr<PerspectiveCamera> m_camera;
     std::unique_ptr<Scene> m_scene;
 
-    std::unordered_map<glm::ivec3, std::unique_ptr<Chunk>> m_chunks;
-    int m_chunksPerAxis{ 0 };
+    std::unique_ptr<ChunkGrid> m_chunkGrid;
+    // Declared after the grid, it saves the grid's chunks when destroyed.
+    std::unique_ptr<ChunkStreamer> m_chunkStreamer;
     float m_cursorDistanceFromCamera{ 10.f };
     float m_cursorScale{ 1.f };
     entid_t m_cursor{ 0 };
+
+    mcube::BrushShape m_brushShape{ mcube::BrushShape::SPHERE };
+    mcube::BrushOperation m_brushOperation{ mcube::BrushOperation::ADD };
+    std::vector<mcube::Brush> m_queuedBrushes;
 };
\ No newline at end of file
@@ -0,0 +1,88 @@
+#include "Benchmark.h"
+
+#include <random>
+
+namespace mcube
+{
+
+template<typename VolumeType>
+static void sculpt_benchmark_volume(VolumeType& volume)
+{
+    // Fixed seed so every resolution and every run meshes the same shape.
+    std::mt19937 rng(1234u);
+    auto random = [&rng]() { return static_cast<float>(rng()) / static_cast<float>(std::mt19937::max()); };
+
+    volume.add_local_sphere({ 0.5f, 0.5f, 0.5f }, 0.35f, 1.f);
+
+    for( uint32_t i = 0; i < 24; i++ )
+    {
+        glm::vec3 position{ random(), random(), random() };
+        float radius = 0.05f + random() * 0.15f;
+        float multiplier = i % 3 == 0 ? -1.f : 1.f;
+        volume.add_local_sphere(position, radius, multiplier);
+    }
+}
+
+template<typename VolumeType, bool UseMipPyramid = false>
+static void run_benchmark_cases(uint32_t resolution, const char* sampleName, uint32_t iterations)
+{
+    constexpr BenchmarkCase cases[]{
+        { "calculate", CalculationFlagBits::MESH },
+        { "calculate_mt", CalculationFlagBits::MESH | CalculationFlagBits::MULTITHREADED },
+        { "shared", CalculationFlagBits::MESH | CalculationFlagBits::SHARED_VERTICES },
+        { "shared_mt", CalculationFlagBits::MESH | CalculationFlagBits::SHARED_VERTICES | CalculationFlagBits::MULTITHREADED },
+        { "surface_nets", CalculationFlagBits::MESH | CalculationFlagBits::SURFACE_NETS },
+        { "surface_nets_mt", CalculationFlagBits::MESH | CalculationFlagBits::SURFACE_NETS | CalculationFlagBits::MULTITHREADED },
+    };
+
+    jclog::Log& log = *g_singleThreadedLog;
+
+    VolumeType volume({ resolution, resolution, resolution });
+    sculpt_benchmark_volume(volume);
+    if constexpr( UseMipPyramid )
+    {
+        volume.set_mip_pyramid_enabled(true);
+    }
+
+    for( const BenchmarkCase& benchCase : cases )
+    {
+        double totalMs{ 0.0 };
+        double bestMs{ std::numeric_limits<double>::max() };
+        size_t vertexCount{ 0 };
+        size_t indexCount{ 0 };
+
+        for( uint32_t i = 0; i < iterations; i++ )
+        {
+            auto begin = std::chrono::high_resolution_clock::now();
+            MeshData data = volume.calculate(benchCase.flags);
+            auto end = std::chrono::high_resolution_clock::now();
+
+            double ms = std::chrono::duration<double, std::milli>(end - begin).count();
+            totalMs += ms;
+            bestMs = std::min(bestMs, ms);
+            vertexCount = data.vertices.size();
+            indexCount = data.indices.size();
+        }
+
+        JCLOG_INFO(log, "{}^3 {:<6} {:<16} avg {:.3f}ms best {:.3f}ms vertices {} indices {}",
+            resolution, sampleName, benchCase.name, totalMs / iterations, bestMs, vertexCount, indexCount);
+    }
+}
+
+void run_benchmark(const std::vector<uint32_t>& resolutions, uint32_t iterations)
+{
+    iterations = std::max(iterations, 1u);
+    jclog::Log& log = *g_singleThreadedLog;
+    JCLOG_INFO(log, "Mesh benchmark, sample classification using {}", get_instruction_set_name(get_classify_instruction_set()));
+
+    for( uint32_t resolution : resolutions )
+    {
+        run_benchmark_cases<Volume<float>>(resolution, "float", iterations);
+        run_benchmark_cases<Volume<float>, true>(resolution, "mip", iterations);
+        run_benchmark_cases<Volume<uint16_t>>(resolution, "u16", iterations);
+        run_benchmark_cases<Volume<uint8_t>>(resolution, "u8", iterations);
+        run_benchmark_cases<SparseVolume<uint8_t>>(resolution, "sparse", iterations);
+    }
+}
+
+} // mcube
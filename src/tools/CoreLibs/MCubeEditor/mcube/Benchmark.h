@@ -0,0 +1,19 @@
+#pragma once
+
+#include "SparseVolume.h"
+
+namespace mcube
+{
+
+struct BenchmarkCase
+{
+    const char* name;
+    CalculationFlags flags;
+};
+
+// Meshes the same sculpted test volume at each resolution through every case for float, float with a mip
+// pyramid skipping uniform blocks, quantized and sparse u8 samples, logging the average and best time along
+// with the size of the output so the meshing paths can be compared directly.
+void run_benchmark(const std::vector<uint32_t>& resolutions, uint32_t iterations);
+
+} // mcube
@@ -0,0 +1,351 @@
+#pragma once
+
+#include "Volume.h"
+
+namespace mcube
+{
+
+// Mesh of a Volume kept as bricks of cubes which are meshed independently, so an edit only regenerates
+// the bricks overlapping the volume's dirty region before the cached bricks are spliced back into one mesh.
+// With SHARED_VERTICES each vertex belongs to the brick containing the lowest sample of its edge. Bricks refer
+// to vertices owned by a neighbour with s_foreignVertex | edge key, these are resolved while splicing so the
+// result shares vertices across brick borders exactly like Volume::calculate.
+// Brick meshes are immutable once meshed and shared between copies made with share(), a remesh replaces a
+// brick's mesh rather than writing to it.
+// VolumeType is anything exposing the region counting pass and edge vertices of Volume, such as SparseVolume.
+template<typename T, typename VolumeType = Volume<T>>
+class BrickedMesh
+{
+public:
+    explicit BrickedMesh(glm::uvec3 dimensions, uint32_t brickSize = s_defaultBrickSize) :
+        m_dimensions(dimensions),
+        m_brickSize(brickSize)
+    {
+        TRAP_EQ(brickSize, 0, "Brick size must be greater than zero.");
+        TRAP_GE(static_cast<uint64_t>(dimensions.x) * dimensions.y * dimensions.z * 3, s_foreignVertex, "Volume is too large for bricked edge keys.");
+
+        m_brickCounts = (m_dimensions - 2u) / m_brickSize + 1u;
+        m_bricks.resize(static_cast<size_t>(m_brickCounts.x) * m_brickCounts.y * m_brickCounts.z);
+
+        for( uint32_t z = 0; z < m_brickCounts.z; z++ )
+        {
+            for( uint32_t y = 0; y < m_brickCounts.y; y++ )
+            {
+                for( uint32_t x = 0; x < m_brickCounts.x; x++ )
+                {
+                    glm::uvec3 first = glm::uvec3(x, y, z) * m_brickSize;
+                    m_bricks[get_brick_index({ x, y, z })].samples = { first, glm::min(first + m_brickSize, m_dimensions - 1u) };
+                }
+            }
+        }
+    }
+
+    ~BrickedMesh()
+    { }
+
+    // Remeshes the bricks touched by the volume's dirty region, or every brick on the first update and whenever
+    // the flags change, and splices the result into get_mesh(). The dirty region is left for the caller to clear.
+    // Returns false if nothing needed remeshing.
+    inline bool update(const VolumeType& volume, CalculationFlags flags)
+    {
+        TRAP_NEQ(volume.get_dimensions(), m_dimensions, "Volume dimensions do not match the bricked mesh.");
+        TRAP_NEQ(flags & CalculationFlagBits::SURFACE_NETS, 0, "Surface nets cannot be meshed in bricks.");
+
+        bool remeshAll = !m_initialized || flags != m_flags;
+        const SampleRegion& dirty = volume.get_dirty_region();
+
+        std::vector<uint32_t> dirtyBricks;
+        for( uint32_t i = 0; i < static_cast<uint32_t>(m_bricks.size()); i++ )
+        {
+            if( remeshAll || m_bricks[i].samples.intersects(dirty) )
+            {
+                dirtyBricks.push_back(i);
+            }
+        }
+
+        if( dirtyBricks.empty() )
+        {
+            if( !m_spliced )
+            {
+                splice();
+            }
+            return false;
+        }
+
+        m_initialized = true;
+        m_flags = flags;
+
+        if( flags & CalculationFlagBits::MULTITHREADED )
+        {
+            JobDispatch::parallel_for_each(dirtyBricks, 1,
+                [&](uint32_t brickIndex)
+                {
+                    mesh_brick(volume, m_bricks[brickIndex]);
+                });
+        }
+        else
+        {
+            for( uint32_t brickIndex : dirtyBricks )
+            {
+                mesh_brick(volume, m_bricks[brickIndex]);
+            }
+        }
+
+        splice();
+        return true;
+    }
+
+    // Copy meshing on from this one which shares every brick mesh with it, so only the bricks the copy
+    // regenerates are allocated anew. The spliced mesh is left out, the copy's next update splices its own.
+    inline BrickedMesh share() const
+    {
+        BrickedMesh copy(m_dimensions, m_brickSize);
+        copy.m_bricks = m_bricks;
+        copy.m_flags = m_flags;
+        copy.m_initialized = m_initialized;
+        return copy;
+    }
+
+    // Forces the next update to remesh every brick.
+    inline void invalidate()
+    {
+        m_initialized = false;
+    }
+
+    inline const MeshData& get_mesh() const
+    {
+        return m_mesh;
+    }
+
+    // Moves the spliced mesh out, the next update remeshes every brick.
+    inline MeshData release_mesh()
+    {
+        m_initialized = false;
+        m_spliced = false;
+        return std::move(m_mesh);
+    }
+
+    inline uint32_t get_brick_size() const
+    {
+        return m_brickSize;
+    }
+private:
+    struct BrickMesh
+    {
+        std::vector<glm::vec3> vertices;
+        // Empty unless meshing with NORMALS.
+        std::vector<glm::vec3> normals;
+        // Brick local indices, or s_foreignVertex | edge key for vertices owned by a neighbouring brick.
+        std::vector<uint32_t> indices;
+        // Edge key and local index of each vertex on the brick's lower faces, sorted by key so the
+        // neighbouring bricks below can resolve the vertices they share.
+        std::vector<std::pair<uint32_t, uint32_t>> sharedVertices;
+    };
+
+    struct Brick
+    {
+        // Samples of the brick's cubes, neighbouring bricks share the samples on their common face.
+        SampleRegion samples;
+        // Null until the brick is first meshed.
+        std::shared_ptr<const BrickMesh> mesh;
+
+        size_t vertexOffset{ 0 };
+        size_t indexOffset{ 0 };
+    };
+
+    inline void mesh_brick(const VolumeType& volume, Brick& brick) const
+    {
+        LookupData* lookup = LookupData::instance();
+        bool interpolate = !static_cast<bool>(m_flags & CalculationFlagBits::NO_INTERPOLATION);
+        bool normals = static_cast<bool>(m_flags & CalculationFlagBits::NORMALS);
+
+        ActiveCubeList activeCubes = volume.find_active_cubes(brick.samples);
+
+        auto mesh = std::make_shared<BrickMesh>();
+        mesh->indices.resize(activeCubes.indexCount);
+
+        if( !(m_flags & CalculationFlagBits::SHARED_VERTICES) )
+        {
+            mesh->vertices.resize(activeCubes.indexCount);
+            mesh->normals.resize(normals ? activeCubes.indexCount : 0);
+            std::iota(mesh->indices.begin(), mesh->indices.end(), 0u);
+
+            for( const ActiveCube& cube : activeCubes.cubes )
+            {
+                const std::array<int8_t, 16>& edges = lookup->get_edges_for_state(cube.state);
+                for( size_t edge = 0, vertex = cube.firstIndex; edges[edge] != -1; edge++, vertex++ )
+                {
+                    uint8_t edgeIndex = static_cast<uint8_t>(edges[edge]);
+                    glm::uvec3 edgeOrigin = glm::uvec3(cube.x, cube.y, cube.z) + lookup->get_edge_origin(edgeIndex);
+                    mesh->vertices[vertex] = volume.get_edge_vertex(edgeOrigin, lookup->get_edge_axis(edgeIndex), interpolate);
+                    if( normals )
+                    {
+                        mesh->normals[vertex] = volume.get_edge_normal(edgeOrigin, lookup->get_edge_axis(edgeIndex), interpolate);
+                    }
+                }
+            }
+            brick.mesh = std::move(mesh);
+            return;
+        }
+
+        mesh->vertices.reserve(activeCubes.edgeCount);
+        mesh->normals.reserve(normals ? activeCubes.edgeCount : 0);
+
+        const glm::uvec3 size = brick.samples.get_size();
+        std::vector<uint32_t> edgeCache(static_cast<size_t>(size.x) * size.y * size.z * 3, s_invalidVertex);
+
+        uint32_t* indexOut = mesh->indices.data();
+        for( const ActiveCube& cube : activeCubes.cubes )
+        {
+            const std::array<int8_t, 16>& edges = lookup->get_edges_for_state(cube.state);
+            for( size_t edge = 0; edges[edge] != -1; edge++ )
+            {
+                uint8_t edgeIndex = static_cast<uint8_t>(edges[edge]);
+                glm::uvec3 edgeOrigin = glm::uvec3(cube.x, cube.y, cube.z) + lookup->get_edge_origin(edgeIndex);
+                uint32_t axis = lookup->get_edge_axis(edgeIndex);
+                uint32_t key = get_edge_key(edgeOrigin, axis);
+
+                if( !owns_sample(brick, edgeOrigin) )
+                {
+                    *indexOut++ = s_foreignVertex | key;
+                    continue;
+                }
+
+                glm::uvec3 local = edgeOrigin - brick.samples.min;
+                uint32_t& cached = edgeCache[((static_cast<size_t>(local.z) * size.y + local.y) * size.x + local.x) * 3 + axis];
+                if( cached == s_invalidVertex )
+                {
+                    cached = static_cast<uint32_t>(mesh->vertices.size());
+                    mesh->vertices.push_back(volume.get_edge_vertex(edgeOrigin, axis, interpolate));
+                    if( normals )
+                    {
+                        mesh->normals.push_back(volume.get_edge_normal(edgeOrigin, axis, interpolate));
+                    }
+
+                    if( glm::any(glm::equal(edgeOrigin, brick.samples.min)) )
+                    {
+                        mesh->sharedVertices.emplace_back(key, cached);
+                    }
+                }
+
+                *indexOut++ = cached;
+            }
+        }
+
+        std::sort(mesh->sharedVertices.begin(), mesh->sharedVertices.end());
+        brick.mesh = std::move(mesh);
+    }
+
+    // Rebuilds the output from every cached brick. This is a copy of the brick buffers with brick local
+    // indices offset and foreign indices resolved, no samples are visited.
+    inline void splice()
+    {
+        size_t vertexCount{ 0 };
+        size_t indexCount{ 0 };
+        for( Brick& brick : m_bricks )
+        {
+            brick.vertexOffset = vertexCount;
+            brick.indexOffset = indexCount;
+            vertexCount += brick.mesh->vertices.size();
+            indexCount += brick.mesh->indices.size();
+        }
+
+        m_mesh.vertices.resize(vertexCount);
+        m_mesh.normals.resize(m_flags & CalculationFlagBits::NORMALS ? vertexCount : 0);
+        m_mesh.indices.resize(indexCount);
+
+        auto spliceBrick = [&](const Brick& brick)
+            {
+                const BrickMesh& mesh = *brick.mesh;
+                std::copy(mesh.vertices.begin(), mesh.vertices.end(), m_mesh.vertices.begin() + brick.vertexOffset);
+                std::copy(mesh.normals.begin(), mesh.normals.end(), m_mesh.normals.begin() + brick.vertexOffset);
+
+                uint32_t* indexOut = m_mesh.indices.data() + brick.indexOffset;
+                for( uint32_t index : mesh.indices )
+                {
+                    if( index & s_foreignVertex )
+                    {
+                        uint32_t key = index & ~s_foreignVertex;
+                        const Brick& owner = m_bricks[get_brick_index(get_owner_brick(get_edge_origin(key)))];
+                        const std::vector<std::pair<uint32_t, uint32_t>>& shared = owner.mesh->sharedVertices;
+                        auto it = std::lower_bound(shared.begin(), shared.end(), key,
+                            [](const std::pair<uint32_t, uint32_t>& vertex, uint32_t value) { return vertex.first < value; });
+
+                        TRAP_EQ(it, shared.end(), "Brick border vertex is missing from the owning brick.");
+                        index = static_cast<uint32_t>(owner.vertexOffset) + it->second;
+                    }
+                    else
+                    {
+                        index += static_cast<uint32_t>(brick.vertexOffset);
+                    }
+
+                    *indexOut++ = index;
+                }
+            };
+
+        if( m_flags & CalculationFlagBits::MULTITHREADED )
+        {
+            JobDispatch::parallel_for_each(m_bricks, 1, spliceBrick);
+        }
+        else
+        {
+            for( const Brick& brick : m_bricks )
+            {
+                spliceBrick(brick);
+            }
+        }
+        m_spliced = true;
+    }
+
+    // A brick owns the edges whose lowest sample lies inside it, samples on its upper faces belong
+    // to the neighbour above unless the brick is the last along that axis.
+    inline bool owns_sample(const Brick& brick, glm::uvec3 sample) const
+    {
+        for( uint32_t axis = 0; axis < 3; axis++ )
+        {
+            if( sample[axis] == brick.samples.max[axis] && brick.samples.max[axis] + 1 != m_dimensions[axis] )
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    inline glm::uvec3 get_owner_brick(glm::uvec3 sample) const
+    {
+        return glm::min(sample / m_brickSize, m_brickCounts - 1u);
+    }
+
+    inline size_t get_brick_index(glm::uvec3 brick) const
+    {
+        return brick.x + (brick.y + static_cast<size_t>(brick.z) * m_brickCounts.y) * m_brickCounts.x;
+    }
+
+    inline uint32_t get_edge_key(glm::uvec3 edgeOrigin, uint32_t axis) const
+    {
+        return (edgeOrigin.x + (edgeOrigin.y + edgeOrigin.z * m_dimensions.y) * m_dimensions.x) * 3 + axis;
+    }
+
+    inline glm::uvec3 get_edge_origin(uint32_t key) const
+    {
+        uint32_t sample = key / 3;
+        return { sample % m_dimensions.x, (sample / m_dimensions.x) % m_dimensions.y, sample / (m_dimensions.x * m_dimensions.y) };
+    }
+private:
+    static constexpr uint32_t s_defaultBrickSize = 8;
+    static constexpr uint32_t s_invalidVertex = std::numeric_limits<uint32_t>::max();
+    static constexpr uint32_t s_foreignVertex = 1u << 31;
+
+    glm::uvec3 m_dimensions;
+    uint32_t m_brickSize;
+    glm::uvec3 m_brickCounts;
+    std::vector<Brick> m_bricks;
+
+    MeshData m_mesh;
+    CalculationFlags m_flags{ 0 };
+    bool m_initialized{ false };
+    // Whether m_mesh holds the current bricks, not so in a copy made with share().
+    bool m_spliced{ false };
+};
+
+} // mcube
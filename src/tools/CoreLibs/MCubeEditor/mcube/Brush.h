@@ -0,0 +1,224 @@
+#pragma once
+
+#include "data/spatial.h"
+
+namespace mcube
+{
+
+enum class BrushShape
+{
+    SPHERE,
+    BOX,
+    CAPSULE,
+    CYLINDER
+};
+
+enum class BrushOperation
+{
+    // Adds density falling off from the centre of the shape scaled by strength, negative strength removes it.
+    ADD,
+    // Polynomial smooth min/max between the volume and the shape, blended in by strength.
+    SMOOTH_UNION,
+    SMOOTH_SUBTRACT,
+    // Carves away everything within the brush bounds that is outside the shape.
+    SMOOTH_INTERSECT,
+    // Blends samples inside the shape towards the average of their neighbours.
+    BLUR,
+    // Blends samples inside the shape towards the plane through position facing axis.
+    FLATTEN
+};
+
+// A single edit applied to a volume. Brushes are described in the space of whatever they are applied to,
+// Volume expects local space where the volume spans 0 to 1 on every axis.
+struct Brush
+{
+    BrushShape shape{ BrushShape::SPHERE };
+    BrushOperation operation{ BrushOperation::ADD };
+
+    glm::vec3 position{ 0.f };
+    // Sphere uses x as the radius, box uses the half extents, capsule and cylinder use x as the radius
+    // and y as the half height along axis.
+    glm::vec3 extents{ 1.f };
+    // Capsule and cylinder axis, plane normal of FLATTEN.
+    glm::vec3 axis{ 0.f, 1.f, 0.f };
+
+    float strength{ 1.f };
+    // Blend distance of the smooth operations.
+    float smoothness{ 0.f };
+    // Applied to the falloff of ADD, linear when null.
+    float(*easeFunc)(float){ nullptr };
+
+    // Region the brush can modify, the shape's bounds grown by the smoothing distance.
+    inline AABoundingBox<float> get_bounds() const
+    {
+        glm::vec3 half{ 0.f };
+        switch( shape )
+        {
+        case BrushShape::SPHERE:
+            half = glm::vec3(extents.x);
+            break;
+        case BrushShape::BOX:
+            half = extents;
+            break;
+        case BrushShape::CAPSULE:
+            half = glm::abs(axis) * extents.y + extents.x;
+            break;
+        case BrushShape::CYLINDER:
+            half = glm::abs(axis) * extents.y + glm::sqrt(glm::max(1.f - axis * axis, 0.f)) * extents.x;
+            break;
+        }
+
+        if( operation != BrushOperation::ADD )
+        {
+            half += smoothness;
+        }
+
+        return { position - half, position + half };
+    }
+
+    // Radius around position containing everything the brush can modify, except for SMOOTH_INTERSECT which
+    // modifies the whole of get_bounds().
+    inline float get_bounding_radius() const
+    {
+        float radius{ 0.f };
+        switch( shape )
+        {
+        case BrushShape::SPHERE:
+            radius = extents.x;
+            break;
+        case BrushShape::BOX:
+            radius = glm::length(extents);
+            break;
+        case BrushShape::CAPSULE:
+            radius = extents.x + extents.y;
+            break;
+        case BrushShape::CYLINDER:
+            radius = glm::length(glm::vec2(extents.x, extents.y));
+            break;
+        }
+
+        return operation == BrushOperation::ADD ? radius : radius + smoothness;
+    }
+
+    // Depth at which the falloff of ADD, BLUR and FLATTEN reaches full strength.
+    inline float get_falloff() const
+    {
+        switch( shape )
+        {
+        case BrushShape::BOX:
+            return std::min(extents.x, std::min(extents.y, extents.z));
+        case BrushShape::CYLINDER:
+            return std::min(extents.x, extents.y);
+        default:
+            return extents.x;
+        }
+    }
+
+    // Signed distances to the shape of count points starting at rowOrigin + (first / spacing, 0, 0), spacing points
+    // along x. The shape is resolved once per row so each loop is straight line math over the row.
+    inline void get_row_distances(glm::vec3 rowOrigin, float spacing, uint32_t first, uint32_t count, float* out) const
+    {
+        const glm::vec3 offset = rowOrigin - position;
+
+        switch( shape )
+        {
+        case BrushShape::SPHERE:
+        {
+            const float yz = offset.y * offset.y + offset.z * offset.z;
+            for( uint32_t i = 0; i < count; i++ )
+            {
+                float dx = (first + i) / spacing + offset.x;
+                out[i] = std::sqrt(dx * dx + yz) - extents.x;
+            }
+            break;
+        }
+        case BrushShape::BOX:
+        {
+            const float qy = std::abs(offset.y) - extents.y;
+            const float qz = std::abs(offset.z) - extents.z;
+            const float outsideYZ = std::max(qy, 0.f) * std::max(qy, 0.f) + std::max(qz, 0.f) * std::max(qz, 0.f);
+            const float insideYZ = std::max(qy, qz);
+            for( uint32_t i = 0; i < count; i++ )
+            {
+                float qx = std::abs((first + i) / spacing + offset.x) - extents.x;
+                float outside = std::sqrt(std::max(qx, 0.f) * std::max(qx, 0.f) + outsideYZ);
+                out[i] = outside + std::min(std::max(qx, insideYZ), 0.f);
+            }
+            break;
+        }
+        case BrushShape::CAPSULE:
+        {
+            // Segment from position - axis * half height to position + axis * half height.
+            const float halfHeight = std::max(extents.y, 1e-6f);
+            for( uint32_t i = 0; i < count; i++ )
+            {
+                glm::vec3 p{ (first + i) / spacing + offset.x, offset.y, offset.z };
+                float along = std::clamp(glm::dot(p, axis), -halfHeight, halfHeight);
+                out[i] = glm::length(p - axis * along) - extents.x;
+            }
+            break;
+        }
+        case BrushShape::CYLINDER:
+        {
+            for( uint32_t i = 0; i < count; i++ )
+            {
+                glm::vec3 p{ (first + i) / spacing + offset.x, offset.y, offset.z };
+                float along = glm::dot(p, axis);
+                float radial = glm::length(p - axis * along) - extents.x;
+                float height = std::abs(along) - extents.y;
+                float outside = std::sqrt(std::max(radial, 0.f) * std::max(radial, 0.f) + std::max(height, 0.f) * std::max(height, 0.f));
+                out[i] = outside + std::min(std::max(radial, height), 0.f);
+            }
+            break;
+        }
+        }
+    }
+
+    static inline Brush create_sphere(glm::vec3 position, float radius, BrushOperation operation, float strength)
+    {
+        Brush retval;
+        retval.shape = BrushShape::SPHERE;
+        retval.operation = operation;
+        retval.position = position;
+        retval.extents = glm::vec3(radius);
+        retval.strength = strength;
+        return retval;
+    }
+
+    static inline Brush create_box(glm::vec3 position, glm::vec3 halfExtents, BrushOperation operation, float strength)
+    {
+        Brush retval;
+        retval.shape = BrushShape::BOX;
+        retval.operation = operation;
+        retval.position = position;
+        retval.extents = halfExtents;
+        retval.strength = strength;
+        return retval;
+    }
+
+    static inline Brush create_capsule(glm::vec3 position, glm::vec3 axis, float radius, float halfHeight, BrushOperation operation, float strength)
+    {
+        Brush retval;
+        retval.shape = BrushShape::CAPSULE;
+        retval.operation = operation;
+        retval.position = position;
+        retval.axis = glm::normalize(axis);
+        retval.extents = { radius, halfHeight, 0.f };
+        retval.strength = strength;
+        return retval;
+    }
+
+    static inline Brush create_cylinder(glm::vec3 position, glm::vec3 axis, float radius, float halfHeight, BrushOperation operation, float strength)
+    {
+        Brush retval;
+        retval.shape = BrushShape::CYLINDER;
+        retval.operation = operation;
+        retval.position = position;
+        retval.axis = glm::normalize(axis);
+        retval.extents = { radius, halfHeight, 0.f };
+        retval.strength = strength;
+        return retval;
+    }
+};
+
+} // mcube
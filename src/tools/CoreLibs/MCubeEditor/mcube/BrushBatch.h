@@ -0,0 +1,290 @@
+#pragma once
+
+#include "Brush.h"
+#include "SampleRegion.h"
+
+namespace mcube
+{
+
+// A batch of local space brushes prepared for one volume. Volumes walk the rows of get_region() in whatever
+// order suits their storage and hand each row to apply_row, which applies every brush overlapping it in order
+// while the row is in cache. The batch only reads samples through the snapshot so it is independent of the
+// volume's storage.
+template<typename T>
+class BrushBatch
+{
+public:
+    explicit BrushBatch(const Brush* brushes, size_t brushCount, glm::uvec3 dimensions, T minValue, T maxValue, T threshold) :
+        m_brushes(brushes),
+        m_brushCount(brushCount),
+        m_brushRegions(brushCount),
+        m_dimensions(dimensions),
+        m_spacing(dimensions - 1u),
+        m_minValue(minValue),
+        m_maxValue(maxValue),
+        m_threshold(threshold)
+    {
+        m_densityScale = static_cast<float>(m_maxValue - m_minValue) * (std::max(m_spacing.x, std::max(m_spacing.y, m_spacing.z)) / 2.f);
+
+        SampleRegion blurRegion;
+        for( size_t i = 0; i < brushCount; i++ )
+        {
+            m_brushRegions[i] = get_local_region(brushes[i].get_bounds(), dimensions);
+            m_region.expand_to_fit(m_brushRegions[i]);
+
+            if( brushes[i].operation == BrushOperation::BLUR )
+            {
+                blurRegion.expand_to_fit(m_brushRegions[i]);
+            }
+        }
+
+        if( !blurRegion.empty() )
+        {
+            // Blurred samples read one sample outside of the brush.
+            m_snapshotRegion = { glm::uvec3(glm::max(glm::ivec3(blurRegion.min) - 1, 0)), glm::min(blurRegion.max + 1u, dimensions - 1u) };
+        }
+    }
+
+    ~BrushBatch()
+    { }
+
+    // Every sample the batch can modify.
+    inline const SampleRegion& get_region() const
+    {
+        return m_region;
+    }
+
+    // Restricts every brush to the samples within limit, used when the samples outside are owned by another
+    // volume. Must be called before any row is applied.
+    inline void clip(const SampleRegion& limit)
+    {
+        m_region = {};
+        for( SampleRegion& brushRegion : m_brushRegions )
+        {
+            brushRegion = brushRegion.get_intersection(limit);
+            m_region.expand_to_fit(brushRegion);
+        }
+    }
+
+    // BLUR reads the samples from before the batch is applied, readRow(first, count, out) copies count
+    // samples of the row starting at first. Must be called before any row is applied.
+    template<typename ReadRow>
+    inline void capture_snapshot(ReadRow&& readRow)
+    {
+        if( m_snapshotRegion.empty() )
+        {
+            return;
+        }
+
+        glm::uvec3 size = m_snapshotRegion.get_size();
+        m_snapshot.resize(static_cast<size_t>(size.x) * size.y * size.z);
+
+        T* snapshotOut = m_snapshot.data();
+        for( uint32_t z = m_snapshotRegion.min.z; z <= m_snapshotRegion.max.z; z++ )
+        {
+            for( uint32_t y = m_snapshotRegion.min.y; y <= m_snapshotRegion.max.y; y++ )
+            {
+                readRow(glm::uvec3(m_snapshotRegion.min.x, y, z), size.x, snapshotOut);
+                snapshotOut += size.x;
+            }
+        }
+    }
+
+    // Applies every brush overlapping the samples from first to lastX of one row, row points at sample first.x.
+    // Rows are clipped to each brush's region and rejected against its bounding radius. distances is scratch
+    // space for at least lastX - first.x + 1 floats.
+    inline void apply_row(glm::uvec3 first, uint32_t lastX, T* row, float* distances) const
+    {
+        glm::vec3 rowOrigin{ 0.f, first.y / m_spacing.y, first.z / m_spacing.z };
+
+        for( size_t i = 0; i < m_brushCount; i++ )
+        {
+            const Brush& brush = m_brushes[i];
+            const SampleRegion& brushRegion = m_brushRegions[i];
+            if( first.y < brushRegion.min.y || first.y > brushRegion.max.y || first.z < brushRegion.min.z || first.z > brushRegion.max.z )
+            {
+                continue;
+            }
+
+            uint32_t beginX = std::max(first.x, brushRegion.min.x);
+            uint32_t endX = std::min(lastX, brushRegion.max.x);
+            if( beginX > endX )
+            {
+                continue;
+            }
+
+            if( brush.operation != BrushOperation::SMOOTH_INTERSECT )
+            {
+                float dy = rowOrigin.y - brush.position.y;
+                float dz = rowOrigin.z - brush.position.z;
+                float radius = brush.get_bounding_radius();
+                if( dy * dy + dz * dz > radius * radius )
+                {
+                    continue;
+                }
+            }
+
+            apply_brush_row(brush, rowOrigin, { beginX, first.y, first.z }, endX, row + (beginX - first.x), distances);
+        }
+    }
+private:
+    // Applies brush to the samples from first to lastX of one row, row points at sample first.x. Distances to the
+    // shape are computed for the whole span first and each operation is then a branch free loop over the span.
+    inline void apply_brush_row(const Brush& brush, glm::vec3 rowOrigin, glm::uvec3 first, uint32_t lastX, T* row, float* distances) const
+    {
+        const uint32_t count = lastX - first.x + 1;
+        brush.get_row_distances(rowOrigin, m_spacing.x, first.x, count, distances);
+
+        const float minValue = static_cast<float>(m_minValue);
+        const float maxValue = static_cast<float>(m_maxValue);
+        const float threshold = static_cast<float>(m_threshold);
+        const float inverseFalloff = 1.f / std::max(brush.get_falloff(), 1e-6f);
+
+        switch( brush.operation )
+        {
+        case BrushOperation::ADD:
+        {
+            for( uint32_t i = 0; i < count; i++ )
+            {
+                distances[i] = -distances[i] * inverseFalloff;
+            }
+
+            if( brush.easeFunc )
+            {
+                for( uint32_t i = 0; i < count; i++ )
+                {
+                    distances[i] = distances[i] >= 0.f ? brush.easeFunc(distances[i]) : -1.f;
+                }
+            }
+
+            const float range = maxValue - minValue;
+            for( uint32_t i = 0; i < count; i++ )
+            {
+                float inside = distances[i] >= 0.f ? 1.f : 0.f;
+                float value = static_cast<float>(row[i]) + inside * (minValue + range * distances[i]) * brush.strength;
+                row[i] = to_sample(std::clamp(value, minValue, maxValue));
+            }
+            break;
+        }
+        case BrushOperation::SMOOTH_UNION:
+        case BrushOperation::SMOOTH_SUBTRACT:
+        case BrushOperation::SMOOTH_INTERSECT:
+        {
+            const float k = std::max(brush.smoothness * m_densityScale, 1e-6f);
+            const float strength = std::clamp(brush.strength, 0.f, 1.f);
+            const BrushOperation operation = brush.operation;
+
+            for( uint32_t i = 0; i < count; i++ )
+            {
+                float current = static_cast<float>(row[i]);
+                float shape = std::clamp(threshold - distances[i] * m_densityScale, minValue, maxValue);
+
+                float result;
+                if( operation == BrushOperation::SMOOTH_UNION )
+                {
+                    result = -smooth_min(-current, -shape, k);
+                }
+                else if( operation == BrushOperation::SMOOTH_SUBTRACT )
+                {
+                    result = smooth_min(current, std::clamp(2.f * threshold - shape, minValue, maxValue), k);
+                }
+                else
+                {
+                    result = smooth_min(current, shape, k);
+                }
+
+                row[i] = to_sample(std::clamp(current + (result - current) * strength, minValue, maxValue));
+            }
+            break;
+        }
+        case BrushOperation::BLUR:
+        {
+            const SampleRegion& snapshotRegion = m_snapshotRegion;
+            const glm::uvec3 snapshotSize = snapshotRegion.get_size();
+            auto snapshotRow = [&](uint32_t y, uint32_t z)
+                {
+                    return m_snapshot.data()
+                        + (static_cast<size_t>(z - snapshotRegion.min.z) * snapshotSize.y + (y - snapshotRegion.min.y)) * snapshotSize.x;
+                };
+
+            const T* centre = snapshotRow(first.y, first.z);
+            const T* below = snapshotRow(first.y > 0 ? first.y - 1 : first.y, first.z);
+            const T* above = snapshotRow(std::min(first.y + 1, m_dimensions.y - 1), first.z);
+            const T* back = snapshotRow(first.y, first.z > 0 ? first.z - 1 : first.z);
+            const T* front = snapshotRow(first.y, std::min(first.z + 1, m_dimensions.z - 1));
+
+            for( uint32_t i = 0; i < count; i++ )
+            {
+                uint32_t x = first.x + i;
+                uint32_t left = (x > 0 ? x - 1 : x) - snapshotRegion.min.x;
+                uint32_t right = std::min(x + 1, m_dimensions.x - 1) - snapshotRegion.min.x;
+                x -= snapshotRegion.min.x;
+
+                float average = (static_cast<float>(centre[x]) + centre[left] + centre[right] + below[x] + above[x] + back[x] + front[x]) / 7.f;
+                float weight = std::clamp(-distances[i] * inverseFalloff, 0.f, 1.f) * brush.strength;
+                float current = static_cast<float>(row[i]);
+                row[i] = to_sample(std::clamp(current + (average - current) * weight, minValue, maxValue));
+            }
+            break;
+        }
+        case BrushOperation::FLATTEN:
+        {
+            const glm::vec3 offset = rowOrigin - brush.position;
+            const float planeOrigin = glm::dot(offset, brush.axis);
+            const float planeStep = brush.axis.x / m_spacing.x;
+
+            for( uint32_t i = 0; i < count; i++ )
+            {
+                float planeDistance = planeOrigin + (first.x + i) * planeStep;
+                float target = std::clamp(threshold - planeDistance * m_densityScale, minValue, maxValue);
+                float weight = std::clamp(-distances[i] * inverseFalloff, 0.f, 1.f) * brush.strength;
+                float current = static_cast<float>(row[i]);
+                row[i] = to_sample(std::clamp(current + (target - current) * weight, minValue, maxValue));
+            }
+            break;
+        }
+        }
+    }
+
+    // Brush kernels work in float, quantized volumes round to the nearest step rather than truncating so edits
+    // smaller than a step in either direction are treated the same.
+    static inline T to_sample(float value)
+    {
+        if constexpr( std::is_integral_v<T> )
+        {
+            return static_cast<T>(std::floor(value + 0.5f));
+        }
+        else
+        {
+            return static_cast<T>(value);
+        }
+    }
+
+    // Polynomial smooth minimum, k is the distance over which the two values are blended.
+    static inline float smooth_min(float a, float b, float k)
+    {
+        float h = std::max(k - std::abs(a - b), 0.f) / k;
+        return std::min(a, b) - h * h * k * 0.25f;
+    }
+
+private:
+    const Brush* m_brushes;
+    size_t m_brushCount;
+    std::vector<SampleRegion> m_brushRegions;
+    SampleRegion m_region;
+
+    glm::uvec3 m_dimensions;
+    glm::vec3 m_spacing;
+    T m_minValue;
+    T m_maxValue;
+    T m_threshold;
+    // Density change per unit of signed distance when a shape is converted into samples, the surface
+    // transition spans two samples.
+    float m_densityScale;
+
+    // Samples around every BLUR brush from before the batch.
+    SampleRegion m_snapshotRegion;
+    std::vector<T> m_snapshot;
+};
+
+} // mcube
@@ -0,0 +1,288 @@
+#include "Classify.h"
+
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// MSVC allows any intrinsic without changing the target, other compilers need it per function.
+#if defined(_MSC_VER)
+#define MCUBE_TARGET_SSE41
+#define MCUBE_TARGET_AVX2
+#else
+#define MCUBE_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define MCUBE_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace mcube
+{
+
+static InstructionSet detect_instruction_set()
+{
+#if defined(_MSC_VER)
+    int info[4]{ };
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+
+    __cpuid(info, 1);
+    bool sse41 = (info[2] & (1 << 19)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+
+    bool avx2{ false };
+    if( maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 0x6) == 0x6 )
+    {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+    }
+#else
+    __builtin_cpu_init();
+    bool sse41 = __builtin_cpu_supports("sse4.1");
+    bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+
+    if( avx2 )
+    {
+        return InstructionSet::AVX2;
+    }
+
+    if( sse41 )
+    {
+        return InstructionSet::SSE41;
+    }
+
+    return InstructionSet::SCALAR;
+}
+
+InstructionSet get_classify_instruction_set()
+{
+    static InstructionSet s_instructionSet = detect_instruction_set();
+    return s_instructionSet;
+}
+
+const char* get_instruction_set_name(InstructionSet set)
+{
+    switch( set )
+    {
+    case InstructionSet::AVX2:
+        return "avx2";
+    case InstructionSet::SSE41:
+        return "sse4.1";
+    default:
+        return "scalar";
+    }
+}
+
+MCUBE_TARGET_SSE41
+static void classify_row_sse41(const float* row, uint32_t count, float threshold, uint64_t* mask)
+{
+    __m128 limit = _mm_set1_ps(threshold);
+
+    uint32_t wholeWords = count / 64u;
+    for( uint32_t word = 0; word < wholeWords; word++ )
+    {
+        const float* samples = row + word * 64u;
+
+        uint64_t bits{ 0 };
+        for( uint32_t i = 0; i < 64u; i += 4u )
+        {
+            __m128 above = _mm_cmpgt_ps(_mm_loadu_ps(samples + i), limit);
+            bits |= static_cast<uint64_t>(_mm_movemask_ps(above)) << i;
+        }
+        mask[word] = bits;
+    }
+
+    if( wholeWords * 64u < count )
+    {
+        classify_row_scalar(row + wholeWords * 64u, count - wholeWords * 64u, threshold, mask + wholeWords);
+    }
+}
+
+MCUBE_TARGET_AVX2
+static void classify_row_avx2(const float* row, uint32_t count, float threshold, uint64_t* mask)
+{
+    __m256 limit = _mm256_set1_ps(threshold);
+
+    uint32_t wholeWords = count / 64u;
+    for( uint32_t word = 0; word < wholeWords; word++ )
+    {
+        const float* samples = row + word * 64u;
+
+        uint64_t bits{ 0 };
+        for( uint32_t i = 0; i < 64u; i += 8u )
+        {
+            __m256 above = _mm256_cmp_ps(_mm256_loadu_ps(samples + i), limit, _CMP_GT_OQ);
+            bits |= static_cast<uint64_t>(_mm256_movemask_ps(above)) << i;
+        }
+        mask[word] = bits;
+    }
+
+    if( wholeWords * 64u < count )
+    {
+        classify_row_scalar(row + wholeWords * 64u, count - wholeWords * 64u, threshold, mask + wholeWords);
+    }
+}
+
+// There is no unsigned integer compare, flipping the sign bit of both sides maps the unsigned order
+// onto the signed one.
+MCUBE_TARGET_SSE41
+static void classify_row_sse41(const uint8_t* row, uint32_t count, uint8_t threshold, uint64_t* mask)
+{
+    __m128i bias = _mm_set1_epi8(static_cast<char>(0x80));
+    __m128i limit = _mm_xor_si128(_mm_set1_epi8(static_cast<char>(threshold)), bias);
+
+    uint32_t wholeWords = count / 64u;
+    for( uint32_t word = 0; word < wholeWords; word++ )
+    {
+        const uint8_t* samples = row + word * 64u;
+
+        uint64_t bits{ 0 };
+        for( uint32_t i = 0; i < 64u; i += 16u )
+        {
+            __m128i values = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i)), bias);
+            bits |= static_cast<uint64_t>(static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpgt_epi8(values, limit)))) << i;
+        }
+        mask[word] = bits;
+    }
+
+    if( wholeWords * 64u < count )
+    {
+        classify_row_scalar(row + wholeWords * 64u, count - wholeWords * 64u, threshold, mask + wholeWords);
+    }
+}
+
+MCUBE_TARGET_AVX2
+static void classify_row_avx2(const uint8_t* row, uint32_t count, uint8_t threshold, uint64_t* mask)
+{
+    __m256i bias = _mm256_set1_epi8(static_cast<char>(0x80));
+    __m256i limit = _mm256_xor_si256(_mm256_set1_epi8(static_cast<char>(threshold)), bias);
+
+    uint32_t wholeWords = count / 64u;
+    for( uint32_t word = 0; word < wholeWords; word++ )
+    {
+        const uint8_t* samples = row + word * 64u;
+
+        uint64_t bits{ 0 };
+        for( uint32_t i = 0; i < 64u; i += 32u )
+        {
+            __m256i values = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(samples + i)), bias);
+            bits |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpgt_epi8(values, limit)))) << i;
+        }
+        mask[word] = bits;
+    }
+
+    if( wholeWords * 64u < count )
+    {
+        classify_row_scalar(row + wholeWords * 64u, count - wholeWords * 64u, threshold, mask + wholeWords);
+    }
+}
+
+// 16 bit results are packed down to bytes with signed saturation, which keeps the all ones and all
+// zeros compare results intact, before taking the byte mask.
+MCUBE_TARGET_SSE41
+static void classify_row_sse41(const uint16_t* row, uint32_t count, uint16_t threshold, uint64_t* mask)
+{
+    __m128i bias = _mm_set1_epi16(static_cast<short>(0x8000));
+    __m128i limit = _mm_xor_si128(_mm_set1_epi16(static_cast<short>(threshold)), bias);
+
+    uint32_t wholeWords = count / 64u;
+    for( uint32_t word = 0; word < wholeWords; word++ )
+    {
+        const uint16_t* samples = row + word * 64u;
+
+        uint64_t bits{ 0 };
+        for( uint32_t i = 0; i < 64u; i += 16u )
+        {
+            __m128i low = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i)), bias);
+            __m128i high = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i + 8u)), bias);
+            __m128i above = _mm_packs_epi16(_mm_cmpgt_epi16(low, limit), _mm_cmpgt_epi16(high, limit));
+            bits |= static_cast<uint64_t>(static_cast<uint32_t>(_mm_movemask_epi8(above))) << i;
+        }
+        mask[word] = bits;
+    }
+
+    if( wholeWords * 64u < count )
+    {
+        classify_row_scalar(row + wholeWords * 64u, count - wholeWords * 64u, threshold, mask + wholeWords);
+    }
+}
+
+MCUBE_TARGET_AVX2
+static void classify_row_avx2(const uint16_t* row, uint32_t count, uint16_t threshold, uint64_t* mask)
+{
+    __m256i bias = _mm256_set1_epi16(static_cast<short>(0x8000));
+    __m256i limit = _mm256_xor_si256(_mm256_set1_epi16(static_cast<short>(threshold)), bias);
+
+    uint32_t wholeWords = count / 64u;
+    for( uint32_t word = 0; word < wholeWords; word++ )
+    {
+        const uint16_t* samples = row + word * 64u;
+
+        uint64_t bits{ 0 };
+        for( uint32_t i = 0; i < 64u; i += 32u )
+        {
+            __m256i low = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(samples + i)), bias);
+            __m256i high = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(samples + i + 16u)), bias);
+            // The pack interleaves the 128 bit lanes of both inputs, restore sample order before the byte mask.
+            __m256i above = _mm256_packs_epi16(_mm256_cmpgt_epi16(low, limit), _mm256_cmpgt_epi16(high, limit));
+            above = _mm256_permute4x64_epi64(above, 0xD8);
+            bits |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(above))) << i;
+        }
+        mask[word] = bits;
+    }
+
+    if( wholeWords * 64u < count )
+    {
+        classify_row_scalar(row + wholeWords * 64u, count - wholeWords * 64u, threshold, mask + wholeWords);
+    }
+}
+
+void classify_row(const float* row, uint32_t count, float threshold, uint64_t* mask)
+{
+    switch( get_classify_instruction_set() )
+    {
+    case InstructionSet::AVX2:
+        classify_row_avx2(row, count, threshold, mask);
+        break;
+    case InstructionSet::SSE41:
+        classify_row_sse41(row, count, threshold, mask);
+        break;
+    default:
+        classify_row_scalar(row, count, threshold, mask);
+        break;
+    }
+}
+
+void classify_row(const uint8_t* row, uint32_t count, uint8_t threshold, uint64_t* mask)
+{
+    switch( get_classify_instruction_set() )
+    {
+    case InstructionSet::AVX2:
+        classify_row_avx2(row, count, threshold, mask);
+        break;
+    case InstructionSet::SSE41:
+        classify_row_sse41(row, count, threshold, mask);
+        break;
+    default:
+        classify_row_scalar(row, count, threshold, mask);
+        break;
+    }
+}
+
+void classify_row(const uint16_t* row, uint32_t count, uint16_t threshold, uint64_t* mask)
+{
+    switch( get_classify_instruction_set() )
+    {
+    case InstructionSet::AVX2:
+        classify_row_avx2(row, count, threshold, mask);
+        break;
+    case InstructionSet::SSE41:
+        classify_row_sse41(row, count, threshold, mask);
+        break;
+    default:
+        classify_row_scalar(row, count, threshold, mask);
+        break;
+    }
+}
+
+} // mcube
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <bit>
+
+namespace mcube
+{
+
+// Sample classification works on bitmasks, one bit per sample along a row, 64 samples per word.
+// Bit x of a row mask is set when sample x is above the threshold.
+constexpr uint32_t get_row_mask_words(uint32_t rowSize)
+{
+    return (rowSize + 63u) / 64u;
+}
+
+enum class InstructionSet
+{
+    SCALAR = 0,
+    SSE41,
+    AVX2
+};
+
+// Highest instruction set supported by this cpu, detected once on first use.
+InstructionSet get_classify_instruction_set();
+const char* get_instruction_set_name(InstructionSet set);
+
+// Thresholds a row of samples into a row mask, the float and quantized versions are vectorized and
+// pick the widest instruction set available at runtime.
+void classify_row(const float* row, uint32_t count, float threshold, uint64_t* mask);
+void classify_row(const uint8_t* row, uint32_t count, uint8_t threshold, uint64_t* mask);
+void classify_row(const uint16_t* row, uint32_t count, uint16_t threshold, uint64_t* mask);
+
+template<typename T>
+inline void classify_row_scalar(const T* row, uint32_t count, T threshold, uint64_t* mask)
+{
+    for( uint32_t word = 0; word < get_row_mask_words(count); word++ )
+    {
+        uint32_t begin = word * 64u;
+        uint32_t end = std::min(begin + 64u, count);
+
+        uint64_t bits{ 0 };
+        for( uint32_t i = begin; i < end; i++ )
+        {
+            bits |= static_cast<uint64_t>(row[i] > threshold) << (i - begin);
+        }
+        mask[word] = bits;
+    }
+}
+
+template<typename T>
+inline void classify_row(const T* row, uint32_t count, T threshold, uint64_t* mask)
+{
+    classify_row_scalar(row, count, threshold, mask);
+}
+
+// Sets count bits of a row mask starting at bit first.
+inline void set_row_mask_bits(uint64_t* mask, uint32_t first, uint32_t count)
+{
+    for( uint32_t bit = first; bit < first + count; )
+    {
+        uint32_t offset = bit % 64u;
+        uint32_t bits = std::min(first + count - bit, 64u - offset);
+        mask[bit / 64u] |= (bits == 64u ? ~uint64_t{ 0 } : (uint64_t{ 1 } << bits) - 1u) << offset;
+        bit += bits;
+    }
+}
+
+// Row mask shifted down by one sample so bit x holds the state of sample x + 1.
+inline uint64_t get_next_sample_bits(const uint64_t* row, uint32_t word, uint32_t rowWords)
+{
+    uint64_t next = row[word] >> 1;
+    if( word + 1 < rowWords )
+    {
+        next |= row[word + 1] << 63;
+    }
+    return next;
+}
+
+// Calls func(x, state) for every cube along a row that the surface passes through. The cube row
+// is bounded by the sample rows b0 (y, z), b1 (y + 1, z), t0 (y, z + 1) and t1 (y + 1, z + 1).
+// Cubes with every corner inside or every corner outside are rejected 64 at a time, the case index
+// of the rest is assembled from the masks with the corner order of LookupData::get_corner_offset.
+template<typename Func>
+inline void for_each_active_cube(const uint64_t* b0, const uint64_t* b1, const uint64_t* t0, const uint64_t* t1, uint32_t rowWords, uint32_t cubeCount, Func&& func)
+{
+    for( uint32_t word = 0; word < rowWords; word++ )
+    {
+        uint32_t first = word * 64u;
+        if( first >= cubeCount )
+        {
+            return;
+        }
+
+        uint64_t b0n = get_next_sample_bits(b0, word, rowWords);
+        uint64_t b1n = get_next_sample_bits(b1, word, rowWords);
+        uint64_t t0n = get_next_sample_bits(t0, word, rowWords);
+        uint64_t t1n = get_next_sample_bits(t1, word, rowWords);
+
+        uint64_t all = b0[word] & b1[word] & t0[word] & t1[word] & b0n & b1n & t0n & t1n;
+        uint64_t any = b0[word] | b1[word] | t0[word] | t1[word] | b0n | b1n | t0n | t1n;
+
+        uint64_t active = any & ~all;
+        if( cubeCount - first < 64u )
+        {
+            active &= (uint64_t{ 1 } << (cubeCount - first)) - 1u;
+        }
+
+        while( active )
+        {
+            uint32_t bit = static_cast<uint32_t>(std::countr_zero(active));
+            active &= active - 1u;
+
+            uint8_t state = static_cast<uint8_t>(
+                  ((b0[word] >> bit) & 1u)
+                | (((b0n >> bit) & 1u) << 1)
+                | (((t0n >> bit) & 1u) << 2)
+                | (((t0[word] >> bit) & 1u) << 3)
+                | (((b1[word] >> bit) & 1u) << 4)
+                | (((b1n >> bit) & 1u) << 5)
+                | (((t1n >> bit) & 1u) << 6)
+                | (((t1[word] >> bit) & 1u) << 7));
+
+            func(first + bit, state);
+        }
+    }
+}
+
+} // mcube
@@ -0,0 +1,176 @@
+#pragma once
+
+#include "Volume.h"
+
+namespace mcube
+{
+
+// Faces of a volume's bounds for add_skirts, bit axis * 2 for the lower face and axis * 2 + 1 for the upper.
+using SkirtFaces = uint8_t;
+
+inline SkirtFaces get_skirt_face(uint32_t axis, bool upper)
+{
+    return static_cast<SkirtFaces>(1u << (axis * 2u + (upper ? 1u : 0u)));
+}
+
+// Sample dimensions of a volume meshed at level of detail level, every level halves the cubes along each
+// axis down to a single cube. The corner samples of both volumes sit on the same bounds.
+inline glm::uvec3 get_lod_dimensions(glm::uvec3 dimensions, uint32_t level)
+{
+    return glm::max(((dimensions - 1u) >> level) + 1u, glm::uvec3(2u));
+}
+
+// Resamples every sample of source into destination with trilinear filtering, the corner samples of both
+// volumes coincide so neighbouring volumes resampled to the same dimensions still agree on their shared face.
+template<typename T, typename VolumeType = Volume<T>>
+inline void downsample(const VolumeType& source, VolumeType& destination)
+{
+    const glm::uvec3 sourceDimensions = source.get_dimensions();
+    const glm::uvec3 dimensions = destination.get_dimensions();
+    const glm::vec3 scale = glm::vec3(sourceDimensions - 1u) / glm::vec3(glm::max(dimensions - 1u, glm::uvec3(1u)));
+
+    std::vector<T> samples(static_cast<size_t>(sourceDimensions.x) * sourceDimensions.y * sourceDimensions.z);
+    for( uint32_t z = 0; z < sourceDimensions.z; z++ )
+    {
+        for( uint32_t y = 0; y < sourceDimensions.y; y++ )
+        {
+            source.read_row({ 0u, y, z }, sourceDimensions.x, samples.data() + (static_cast<size_t>(z) * sourceDimensions.y + y) * sourceDimensions.x);
+        }
+    }
+
+    auto sample = [&](glm::uvec3 loc) -> float
+        {
+            return static_cast<float>(samples[(static_cast<size_t>(loc.z) * sourceDimensions.y + loc.y) * sourceDimensions.x + loc.x]);
+        };
+
+    std::vector<T> row(dimensions.x);
+    for( uint32_t z = 0; z < dimensions.z; z++ )
+    {
+        for( uint32_t y = 0; y < dimensions.y; y++ )
+        {
+            for( uint32_t x = 0; x < dimensions.x; x++ )
+            {
+                glm::vec3 position = glm::min(glm::vec3(x, y, z) * scale, glm::vec3(sourceDimensions - 1u));
+                glm::uvec3 first = glm::min(glm::uvec3(position), sourceDimensions - 2u);
+                glm::vec3 t = position - glm::vec3(first);
+
+                float value{ 0.f };
+                for( uint32_t corner = 0; corner < 8; corner++ )
+                {
+                    glm::uvec3 offset{ corner & 1u, (corner >> 1) & 1u, (corner >> 2) & 1u };
+                    glm::vec3 weights = glm::mix(1.f - t, t, glm::vec3(offset));
+                    value += weights.x * weights.y * weights.z * sample(first + offset);
+                }
+
+                row[x] = std::is_integral_v<T> ? static_cast<T>(std::round(value)) : static_cast<T>(value);
+            }
+            destination.write_row({ 0u, y, z }, dimensions.x, row.data());
+        }
+    }
+}
+
+// Appends skirts below the surface's boundary on the given faces of a mesh in volume space, where every
+// vertex lies within [0, 1]. Each boundary edge is extruded by depth within the face plane towards the solid
+// side of the surface, facing out of the volume. Meshes of neighbouring volumes at a different level of
+// detail meet the face along different lines, the skirt of whichever surface reaches further out covers the
+// crack between them as long as depth spans a cube of the coarser level. Skirt vertices copy the normals of
+// the border they hang from, if the mesh has normals.
+inline void add_skirts(MeshData& mesh, SkirtFaces faces, float depth)
+{
+    if( faces == 0 )
+    {
+        return;
+    }
+
+    const size_t triangleIndexCount = mesh.indices.size();
+    for( uint32_t face = 0; face < 6; face++ )
+    {
+        if( !(faces & (1u << face)) )
+        {
+            continue;
+        }
+
+        const uint32_t axis = face / 2u;
+        const float plane = face & 1u ? 1.f : 0.f;
+        glm::vec3 outward{ 0.f };
+        outward[axis] = face & 1u ? 1.f : -1.f;
+
+        // Edges of the surface's triangles lying in the face, with the direction towards the solid side
+        // accumulated on their vertices from every triangle they bound.
+        std::vector<std::pair<uint32_t, uint32_t>> edges;
+        std::unordered_map<uint32_t, glm::vec3> inward;
+
+        for( size_t i = 0; i + 2 < triangleIndexCount; i += 3 )
+        {
+            const uint32_t triangle[3]{ mesh.indices[i], mesh.indices[i + 1], mesh.indices[i + 2] };
+            glm::vec3 normal = glm::cross(mesh.vertices[triangle[1]] - mesh.vertices[triangle[0]], mesh.vertices[triangle[2]] - mesh.vertices[triangle[0]]);
+
+            // Triangle normals point out of the solid, its side of the face lies against the normal.
+            glm::vec3 solid = -normal;
+            solid[axis] = 0.f;
+
+            for( uint32_t edge = 0; edge < 3; edge++ )
+            {
+                uint32_t a = triangle[edge];
+                uint32_t b = triangle[(edge + 1) % 3];
+                uint32_t other = triangle[(edge + 2) % 3];
+                if( mesh.vertices[a][axis] != plane || mesh.vertices[b][axis] != plane || mesh.vertices[other][axis] == plane )
+                {
+                    continue;
+                }
+
+                edges.emplace_back(a, b);
+                inward.try_emplace(a, 0.f).first->second += solid;
+                inward.try_emplace(b, 0.f).first->second += solid;
+            }
+        }
+
+        // Skirts have vertices of their own so they do not bend the surface's normals at the border.
+        std::unordered_map<uint32_t, std::pair<uint32_t, uint32_t>> skirtVertices;
+        for( auto& [vertex, direction] : inward )
+        {
+            float length = glm::length(direction);
+            if( length <= 0.f )
+            {
+                continue;
+            }
+
+            glm::vec3 position = mesh.vertices[vertex];
+            uint32_t top = static_cast<uint32_t>(mesh.vertices.size());
+            mesh.vertices.push_back(position);
+            mesh.vertices.push_back(position + direction * (depth / length));
+
+            if( !mesh.normals.empty() )
+            {
+                glm::vec3 normal = mesh.normals[vertex];
+                mesh.normals.push_back(normal);
+                mesh.normals.push_back(normal);
+            }
+            skirtVertices.insert(std::pair(vertex, std::pair(top, top + 1)));
+        }
+
+        for( auto [a, b] : edges )
+        {
+            auto skirtA = skirtVertices.find(a);
+            auto skirtB = skirtVertices.find(b);
+            if( skirtA == skirtVertices.end() || skirtB == skirtVertices.end() )
+            {
+                continue;
+            }
+
+            auto [topA, bottomA] = skirtA->second;
+            auto [topB, bottomB] = skirtB->second;
+
+            glm::vec3 normal = glm::cross(mesh.vertices[topB] - mesh.vertices[topA], mesh.vertices[bottomA] - mesh.vertices[topA]);
+            if( glm::dot(normal, outward) < 0.f )
+            {
+                std::swap(topA, topB);
+                std::swap(bottomA, bottomB);
+            }
+
+            mesh.indices.insert(mesh.indices.end(), { topA, topB, bottomA, topB, bottomB, bottomA });
+        }
+    }
+}
+
+} // mcube
@@ -260,12 +260,28 @@ LookupData::LookupData() :
         { 1, 3, 8, 9, 1, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
         { 0, 9, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
         { 0, 3, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
-        {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 } }}
-{ }
+        {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 } }},
+    m_triangleCounts{ }
+{
+    for( size_t state = 0; state < m_triangulation.size(); state++ )
+    {
+        uint8_t count{ 0 };
+        while( count < 5 && m_triangulation[state][count * 3] != -1 )
+        {
+            count++;
+        }
+        m_triangleCounts[state] = count;
+    }
+}
 
 const std::array<int8_t, 16>& LookupData::get_edges_for_state(uint8_t state) const
 {
     return m_triangulation.at(state);
 }
 
+uint8_t LookupData::get_triangle_count(uint8_t state) const
+{
+    return m_triangleCounts[state];
+}
+
 } // mcube
\ No newline at end of file
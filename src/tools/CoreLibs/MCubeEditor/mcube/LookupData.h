@@ -9,6 +9,7 @@ public:
     LookupData();
 
     const std::array<int8_t, 16>& get_edges_for_state(uint8_t state) const;
+    uint8_t get_triangle_count(uint8_t state) const;
 
     constexpr glm::uvec3 get_corner_offset(uint32_t index) const
     {
@@ -32,8 +33,38 @@ public:
         constexpr std::array<uint8_t, 12> edgeCornersB{ 1, 2, 3, 0, 5, 6, 7, 4, 4, 5, 6, 7 };
         return std::make_pair(edgeCornersA[edgeIndex], edgeCornersB[edgeIndex]);
     }
+
+    // Lowest corner of the edge relative to the cube origin, every grid edge can be uniquely
+    // identified by this location and the axis the edge runs along.
+    constexpr glm::uvec3 get_edge_origin(uint8_t edgeIndex) const
+    {
+        constexpr std::array<glm::uvec3, 12> origins(
+            {
+                { 0, 0, 0 },
+                { 1, 0, 0 },
+                { 0, 0, 1 },
+                { 0, 0, 0 },
+                { 0, 1, 0 },
+                { 1, 1, 0 },
+                { 0, 1, 1 },
+                { 0, 1, 0 },
+                { 0, 0, 0 },
+                { 1, 0, 0 },
+                { 1, 0, 1 },
+                { 0, 0, 1 }
+            });
+        return origins[edgeIndex];
+    }
+
+    // 0 = x, 1 = y, 2 = z
+    constexpr uint32_t get_edge_axis(uint8_t edgeIndex) const
+    {
+        constexpr std::array<uint32_t, 12> axis{ 0, 2, 0, 2, 0, 2, 0, 2, 1, 1, 1, 1 };
+        return axis[edgeIndex];
+    }
 private:
     std::array<std::array<int8_t, 16>, 256> m_triangulation;
+    std::array<uint8_t, 256> m_triangleCounts;
 public:
     static LookupData *const instance()
     {
@@ -0,0 +1,198 @@
+#pragma once
+
+#include "SampleRegion.h"
+
+namespace mcube
+{
+
+// Min, max and average of a volume's samples over blocks of cubes, coarsening by two along each axis per level
+// until a single cell spans the volume. A level 0 cell covers cellSize cubes, so cellSize + 1 samples along
+// each axis, neighbouring cells share the samples on their common face and the bounds of a cell hold for every
+// cube within it. Cells whose range does not straddle the threshold contain no surface, which lets meshing and
+// ray marching skip whole blocks, and the averages are a prefiltered coarse copy of the volume.
+// Cells are recomputed for the region an edit touched rather than rebuilt, see update.
+template<typename T>
+class MipPyramid
+{
+public:
+    struct Cell
+    {
+        T min;
+        T max;
+        float average;
+    };
+
+    explicit MipPyramid(glm::uvec3 dimensions, uint32_t cellSize = s_defaultCellSize) :
+        m_dimensions(dimensions),
+        m_cellSize(cellSize)
+    {
+        TRAP_EQ(cellSize, 0, "Cell size must be greater than zero.");
+
+        glm::uvec3 counts = (glm::max(dimensions, glm::uvec3(2u)) - 2u) / cellSize + 1u;
+        while( true )
+        {
+            Level& level = m_levels.emplace_back();
+            level.counts = counts;
+            level.cells.resize(static_cast<size_t>(counts.x) * counts.y * counts.z);
+
+            if( counts == glm::uvec3(1u) )
+            {
+                break;
+            }
+            counts = (counts + 1u) / 2u;
+        }
+    }
+
+    ~MipPyramid()
+    { }
+
+    // Recomputes every cell holding a sample of region, then their parents. readRow(first, count, out) reads
+    // count samples of the volume starting at first.
+    template<typename ReadRow>
+    inline void update(const SampleRegion& region, ReadRow&& readRow)
+    {
+        if( region.empty() )
+        {
+            return;
+        }
+
+        // A sample on the lower face of a cell is also the last sample of the cell below.
+        glm::uvec3 first = glm::min((glm::max(region.min, glm::uvec3(1u)) - 1u) / m_cellSize, m_levels[0].counts - 1u);
+        glm::uvec3 last = glm::min(region.max / m_cellSize, m_levels[0].counts - 1u);
+
+        std::vector<T> row(m_cellSize + 1);
+        for( uint32_t z = first.z; z <= last.z; z++ )
+        {
+            for( uint32_t y = first.y; y <= last.y; y++ )
+            {
+                for( uint32_t x = first.x; x <= last.x; x++ )
+                {
+                    glm::uvec3 cell{ x, y, z };
+                    glm::uvec3 sampleMin = cell * m_cellSize;
+                    glm::uvec3 sampleMax = glm::min(sampleMin + m_cellSize, m_dimensions - 1u);
+                    uint32_t count = sampleMax.x - sampleMin.x + 1;
+
+                    Cell result{ std::numeric_limits<T>::max(), std::numeric_limits<T>::lowest(), 0.f };
+                    double total{ 0.0 };
+                    for( uint32_t sz = sampleMin.z; sz <= sampleMax.z; sz++ )
+                    {
+                        for( uint32_t sy = sampleMin.y; sy <= sampleMax.y; sy++ )
+                        {
+                            readRow(glm::uvec3(sampleMin.x, sy, sz), count, row.data());
+                            for( uint32_t i = 0; i < count; i++ )
+                            {
+                                result.min = std::min(result.min, row[i]);
+                                result.max = std::max(result.max, row[i]);
+                                total += static_cast<double>(row[i]);
+                            }
+                        }
+                    }
+
+                    glm::uvec3 size = sampleMax - sampleMin + 1u;
+                    result.average = static_cast<float>(total / (static_cast<double>(size.x) * size.y * size.z));
+                    m_levels[0].cells[get_cell_index(0, cell)] = result;
+                }
+            }
+        }
+
+        for( uint32_t level = 1; level < get_level_count(); level++ )
+        {
+            first /= 2u;
+            last /= 2u;
+
+            for( uint32_t z = first.z; z <= last.z; z++ )
+            {
+                for( uint32_t y = first.y; y <= last.y; y++ )
+                {
+                    for( uint32_t x = first.x; x <= last.x; x++ )
+                    {
+                        m_levels[level].cells[get_cell_index(level, { x, y, z })] = merge_children(level, { x, y, z });
+                    }
+                }
+            }
+        }
+    }
+
+    inline uint32_t get_level_count() const
+    {
+        return static_cast<uint32_t>(m_levels.size());
+    }
+
+    inline glm::uvec3 get_cell_counts(uint32_t level) const
+    {
+        return m_levels.at(level).counts;
+    }
+
+    // Cubes along each axis of a cell at level.
+    inline uint32_t get_cell_size(uint32_t level) const
+    {
+        return m_cellSize << level;
+    }
+
+    // Cell at level holding cube, the cube with cube as its lowest sample.
+    inline glm::uvec3 get_cell_of_cube(uint32_t level, glm::uvec3 cube) const
+    {
+        return glm::min(cube / get_cell_size(level), get_cell_counts(level) - 1u);
+    }
+
+    inline const Cell& get_cell(uint32_t level, glm::uvec3 cell) const
+    {
+        return m_levels.at(level).cells[get_cell_index(level, cell)];
+    }
+
+    // Whether every sample of the cell lies on the same side of threshold, with the inside being above it.
+    inline bool is_uniform(uint32_t level, glm::uvec3 cell, T threshold) const
+    {
+        const Cell& data = get_cell(level, cell);
+        return data.min > threshold || data.max <= threshold;
+    }
+private:
+    struct Level
+    {
+        glm::uvec3 counts;
+        std::vector<Cell> cells;
+    };
+
+    inline size_t get_cell_index(uint32_t level, glm::uvec3 cell) const
+    {
+        const glm::uvec3& counts = m_levels[level].counts;
+        TRAP_GE(cell.x, counts.x, "Cell out of bounds.");
+        TRAP_GE(cell.y, counts.y, "Cell out of bounds.");
+        TRAP_GE(cell.z, counts.z, "Cell out of bounds.");
+        return cell.x + (static_cast<size_t>(cell.y) + static_cast<size_t>(cell.z) * counts.y) * counts.x;
+    }
+
+    inline Cell merge_children(uint32_t level, glm::uvec3 cell) const
+    {
+        glm::uvec3 first = cell * 2u;
+        glm::uvec3 last = glm::min(first + 1u, m_levels[level - 1].counts - 1u);
+
+        Cell retval{ std::numeric_limits<T>::max(), std::numeric_limits<T>::lowest(), 0.f };
+        uint32_t count{ 0 };
+        for( uint32_t z = first.z; z <= last.z; z++ )
+        {
+            for( uint32_t y = first.y; y <= last.y; y++ )
+            {
+                for( uint32_t x = first.x; x <= last.x; x++ )
+                {
+                    const Cell& child = get_cell(level - 1, { x, y, z });
+                    retval.min = std::min(retval.min, child.min);
+                    retval.max = std::max(retval.max, child.max);
+                    retval.average += child.average;
+                    count++;
+                }
+            }
+        }
+
+        retval.average /= static_cast<float>(count);
+        return retval;
+    }
+private:
+    static constexpr uint32_t s_defaultCellSize = 8;
+
+    glm::uvec3 m_dimensions;
+    uint32_t m_cellSize;
+    std::vector<Level> m_levels;
+};
+
+} // mcube
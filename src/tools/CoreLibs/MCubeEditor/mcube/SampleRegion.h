@@ -0,0 +1,71 @@
+#pragma once
+
+#include "data/spatial.h"
+
+namespace mcube
+{
+
+// Inclusive range of sample locations, empty while min is greater than max on any axis.
+struct SampleRegion
+{
+    glm::uvec3 min{ std::numeric_limits<uint32_t>::max() };
+    glm::uvec3 max{ 0u };
+
+    inline bool empty() const
+    {
+        return min.x > max.x || min.y > max.y || min.z > max.z;
+    }
+
+    inline glm::uvec3 get_size() const
+    {
+        return max - min + 1u;
+    }
+
+    inline bool intersects(const SampleRegion& other) const
+    {
+        return !empty() && !other.empty()
+            && glm::all(glm::lessThanEqual(min, other.max))
+            && glm::all(glm::lessThanEqual(other.min, max));
+    }
+
+    inline SampleRegion get_intersection(const SampleRegion& other) const
+    {
+        if( !intersects(other) )
+        {
+            return {};
+        }
+
+        return { glm::max(min, other.min), glm::min(max, other.max) };
+    }
+
+    inline void expand_to_fit(const SampleRegion& other)
+    {
+        if( other.empty() )
+        {
+            return;
+        }
+
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+};
+
+// Samples within the local space bounds of a volume with the given dimensions, clamped to the volume.
+inline SampleRegion get_local_region(const AABoundingBox<float>& bounds, glm::uvec3 dimensions)
+{
+    glm::vec3 scale(dimensions - 1u);
+    glm::vec3 lower = glm::ceil(bounds.min * scale);
+    glm::vec3 upper = glm::floor(bounds.max * scale);
+
+    if( glm::any(glm::lessThan(upper, glm::vec3(0.f))) || glm::any(glm::greaterThan(lower, scale)) )
+    {
+        return {};
+    }
+
+    return {
+        glm::uvec3(glm::max(lower, glm::vec3(0.f))),
+        glm::uvec3(glm::min(upper, scale))
+    };
+}
+
+} // mcube
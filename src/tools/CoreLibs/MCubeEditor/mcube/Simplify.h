@@ -0,0 +1,316 @@
+#pragma once
+
+#include "Volume.h"
+
+#include <queue>
+
+namespace mcube
+{
+
+// Sum of squared distances to a set of planes, the symmetric 4x4 matrix of Garland and Heckbert stored as its
+// upper triangle.
+struct Quadric
+{
+    std::array<double, 10> m{};
+
+    inline void add_plane(glm::dvec3 normal, double distance)
+    {
+        const double plane[4]{ normal.x, normal.y, normal.z, distance };
+        for( uint32_t row = 0, i = 0; row < 4; row++ )
+        {
+            for( uint32_t column = row; column < 4; column++ )
+            {
+                m[i++] += plane[row] * plane[column];
+            }
+        }
+    }
+
+    inline Quadric& operator+=(const Quadric& other)
+    {
+        for( size_t i = 0; i < m.size(); i++ )
+        {
+            m[i] += other.m[i];
+        }
+        return *this;
+    }
+
+    inline double evaluate(glm::vec3 point) const
+    {
+        const double x = point.x;
+        const double y = point.y;
+        const double z = point.z;
+        return m[0] * x * x + 2.0 * m[1] * x * y + 2.0 * m[2] * x * z + 2.0 * m[3] * x
+            + m[4] * y * y + 2.0 * m[5] * y * z + 2.0 * m[6] * y
+            + m[7] * z * z + 2.0 * m[8] * z
+            + m[9];
+    }
+};
+
+// Collapses edges of an indexed mesh in volume space while the squared distances from the moved vertex to
+// the planes of the triangles merged into it stay within maxError squared. Every collapse moves a vertex onto
+// a neighbour, so the remaining vertices and their normals are untouched. Vertices on the volume's bounds and
+// on open edges never move, which keeps the seams towards neighbouring volumes identical on both sides.
+// Only meshes with shared vertices simplify, see CalculationFlagBits::SHARED_VERTICES.
+inline void simplify(MeshData& mesh, float maxError)
+{
+    const size_t vertexCount = mesh.vertices.size();
+    const size_t triangleCount = mesh.indices.size() / 3;
+    if( triangleCount == 0 || maxError <= 0.f )
+    {
+        return;
+    }
+
+    std::vector<std::array<uint32_t, 3>> triangles(triangleCount);
+    std::vector<bool> removedTriangles(triangleCount, false);
+    std::vector<std::vector<uint32_t>> vertexTriangles(vertexCount);
+    std::vector<Quadric> quadrics(vertexCount);
+
+    for( uint32_t triangle = 0; triangle < triangleCount; triangle++ )
+    {
+        std::array<uint32_t, 3>& corners = triangles[triangle];
+        std::copy_n(mesh.indices.begin() + triangle * 3, 3, corners.begin());
+
+        glm::dvec3 a = mesh.vertices[corners[0]];
+        glm::dvec3 normal = glm::cross(glm::dvec3(mesh.vertices[corners[1]]) - a, glm::dvec3(mesh.vertices[corners[2]]) - a);
+        double length = glm::length(normal);
+        if( length > 0.0 )
+        {
+            normal /= length;
+            Quadric plane;
+            plane.add_plane(normal, -glm::dot(normal, a));
+            for( uint32_t corner : corners )
+            {
+                quadrics[corner] += plane;
+            }
+        }
+
+        for( uint32_t corner : corners )
+        {
+            vertexTriangles[corner].push_back(triangle);
+        }
+    }
+
+    std::vector<bool> locked(vertexCount, false);
+    for( size_t vertex = 0; vertex < vertexCount; vertex++ )
+    {
+        const glm::vec3& position = mesh.vertices[vertex];
+        for( uint32_t axis = 0; axis < 3; axis++ )
+        {
+            locked[vertex] = locked[vertex] || position[axis] <= 0.f || position[axis] >= 1.f;
+        }
+    }
+
+    // Edges bounding a single triangle are open, a collapse next to them would tear the surface.
+    std::unordered_map<uint64_t, uint32_t> edgeUses;
+    auto getEdgeKey = [](uint32_t a, uint32_t b)
+        {
+            return (static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b);
+        };
+    for( const std::array<uint32_t, 3>& corners : triangles )
+    {
+        for( uint32_t edge = 0; edge < 3; edge++ )
+        {
+            edgeUses[getEdgeKey(corners[edge], corners[(edge + 1) % 3])]++;
+        }
+    }
+    for( auto& [key, uses] : edgeUses )
+    {
+        if( uses != 2 )
+        {
+            locked[static_cast<uint32_t>(key >> 32)] = true;
+            locked[static_cast<uint32_t>(key)] = true;
+        }
+    }
+
+    auto getNeighbours = [&](uint32_t vertex, std::vector<uint32_t>& neighbours)
+        {
+            neighbours.clear();
+            for( uint32_t triangle : vertexTriangles[vertex] )
+            {
+                for( uint32_t corner : triangles[triangle] )
+                {
+                    if( corner != vertex && std::find(neighbours.begin(), neighbours.end(), corner) == neighbours.end() )
+                    {
+                        neighbours.push_back(corner);
+                    }
+                }
+            }
+        };
+
+    // Collapses of from onto to, stale once either vertex changed after the collapse was queued.
+    struct Collapse
+    {
+        double cost;
+        uint32_t from;
+        uint32_t to;
+        uint32_t fromStamp;
+        uint32_t toStamp;
+
+        bool operator>(const Collapse& other) const
+        {
+            return cost > other.cost;
+        }
+    };
+
+    const double maxCost = static_cast<double>(maxError) * maxError;
+    std::vector<uint32_t> stamps(vertexCount, 0);
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> queue;
+
+    auto queueCollapse = [&](uint32_t from, uint32_t to)
+        {
+            if( locked[from] )
+            {
+                return;
+            }
+
+            Quadric merged = quadrics[from];
+            merged += quadrics[to];
+            double cost = merged.evaluate(mesh.vertices[to]);
+            if( cost <= maxCost )
+            {
+                queue.push({ cost, from, to, stamps[from], stamps[to] });
+            }
+        };
+
+    std::vector<uint32_t> neighbours;
+    for( uint32_t vertex = 0; vertex < vertexCount; vertex++ )
+    {
+        getNeighbours(vertex, neighbours);
+        for( uint32_t neighbour : neighbours )
+        {
+            queueCollapse(vertex, neighbour);
+        }
+    }
+
+    std::vector<uint32_t> toNeighbours;
+    while( !queue.empty() )
+    {
+        Collapse collapse = queue.top();
+        queue.pop();
+
+        const uint32_t from = collapse.from;
+        const uint32_t to = collapse.to;
+        if( collapse.fromStamp != stamps[from] || collapse.toStamp != stamps[to] )
+        {
+            continue;
+        }
+
+        // Both ends of an edge inside a manifold share exactly the two vertices opposite the edge, any other
+        // shared neighbour would fold the surface onto itself.
+        getNeighbours(from, neighbours);
+        getNeighbours(to, toNeighbours);
+        if( std::find(neighbours.begin(), neighbours.end(), to) == neighbours.end() )
+        {
+            continue;
+        }
+
+        uint32_t shared{ 0 };
+        for( uint32_t neighbour : neighbours )
+        {
+            shared += std::find(toNeighbours.begin(), toNeighbours.end(), neighbour) != toNeighbours.end() ? 1 : 0;
+        }
+        if( shared != 2 )
+        {
+            continue;
+        }
+
+        // Triangles which keep existing must not flip or degenerate once from moves onto to.
+        bool flips{ false };
+        for( uint32_t triangle : vertexTriangles[from] )
+        {
+            const std::array<uint32_t, 3>& corners = triangles[triangle];
+            if( std::find(corners.begin(), corners.end(), to) != corners.end() )
+            {
+                continue;
+            }
+
+            glm::vec3 before[3];
+            glm::vec3 after[3];
+            for( uint32_t corner = 0; corner < 3; corner++ )
+            {
+                before[corner] = mesh.vertices[corners[corner]];
+                after[corner] = corners[corner] == from ? mesh.vertices[to] : before[corner];
+            }
+
+            glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+            glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+            if( glm::dot(normalBefore, normalAfter) <= 0.f )
+            {
+                flips = true;
+                break;
+            }
+        }
+        if( flips )
+        {
+            continue;
+        }
+
+        for( uint32_t triangle : vertexTriangles[from] )
+        {
+            std::array<uint32_t, 3>& corners = triangles[triangle];
+            if( std::find(corners.begin(), corners.end(), to) != corners.end() )
+            {
+                removedTriangles[triangle] = true;
+                for( uint32_t corner : corners )
+                {
+                    if( corner != from )
+                    {
+                        std::erase(vertexTriangles[corner], triangle);
+                    }
+                }
+                continue;
+            }
+
+            std::replace(corners.begin(), corners.end(), from, to);
+            vertexTriangles[to].push_back(triangle);
+        }
+        vertexTriangles[from].clear();
+
+        quadrics[to] += quadrics[from];
+        stamps[from]++;
+        stamps[to]++;
+
+        getNeighbours(to, neighbours);
+        for( uint32_t neighbour : neighbours )
+        {
+            queueCollapse(to, neighbour);
+            queueCollapse(neighbour, to);
+        }
+    }
+
+    // Compacts the surviving vertices in their original order.
+    std::vector<uint32_t> remap(vertexCount, std::numeric_limits<uint32_t>::max());
+    std::vector<glm::vec3> vertices;
+    std::vector<glm::vec3> normals;
+    for( uint32_t vertex = 0; vertex < vertexCount; vertex++ )
+    {
+        if( vertexTriangles[vertex].empty() )
+        {
+            continue;
+        }
+
+        remap[vertex] = static_cast<uint32_t>(vertices.size());
+        vertices.push_back(mesh.vertices[vertex]);
+        if( !mesh.normals.empty() )
+        {
+            normals.push_back(mesh.normals[vertex]);
+        }
+    }
+
+    mesh.indices.clear();
+    for( uint32_t triangle = 0; triangle < triangleCount; triangle++ )
+    {
+        if( !removedTriangles[triangle] )
+        {
+            for( uint32_t corner : triangles[triangle] )
+            {
+                mesh.indices.push_back(remap[corner]);
+            }
+        }
+    }
+
+    mesh.vertices = std::move(vertices);
+    mesh.normals = std::move(normals);
+}
+
+} // mcube
@@ -0,0 +1,544 @@
+#pragma once
+
+#include <cstring>
+
+#include "BrickedMesh.h"
+
+namespace mcube
+{
+
+// Drop in alternative to Volume which stores its samples in bricks of s_brickSize^3. A brick whose samples all
+// hold the same value collapses to that single value, so empty and solid space cost a few bytes per brick and
+// memory follows the surface rather than the resolution cubed.
+// Meshing goes through BrickedMesh with its bricks aligned to the storage bricks. Any region whose storage bricks
+// are all uniform on the same side of the threshold is skipped without visiting a sample.
+template<typename T>
+class SparseVolume
+{
+public:
+    explicit SparseVolume(glm::uvec3 dimensions) :
+        SparseVolume(dimensions, SampleTraits<T>::minValue, SampleTraits<T>::maxValue, SampleTraits<T>::threshold)
+    { }
+
+    explicit SparseVolume(glm::uvec3 dimensions, T minValue, T maxValue, T threshold) :
+        m_minValue(minValue),
+        m_maxValue(maxValue),
+        m_threshold(threshold),
+        m_dimensions(dimensions),
+        m_brickCounts((dimensions + s_brickSize - 1u) / s_brickSize)
+    {
+        TRAP_LT(threshold, minValue, "Threshold is lower than minimum value.");
+        TRAP_GT(threshold, maxValue, "Threshold is greater than maximum value.");
+
+        m_bricks.resize(static_cast<size_t>(m_brickCounts.x) * m_brickCounts.y * m_brickCounts.z);
+        for( Brick& brick : m_bricks )
+        {
+            brick.value = minValue;
+        }
+    }
+
+    ~SparseVolume()
+    { }
+
+    [[nodiscard]]
+    inline MeshData calculate(CalculationFlags flags = MESH) const
+    {
+        TRAP_EQ(flags, 0, "Invalid flags set to calculate.");
+
+        if( flags & CalculationFlagBits::SURFACE_NETS )
+        {
+            return calculate_surface_nets(*this, find_active_cubes(), flags);
+        }
+
+        BrickedMesh<T, SparseVolume<T>> mesh(m_dimensions, s_brickSize);
+        mesh.update(*this, flags);
+        return mesh.release_mesh();
+    }
+
+    [[nodiscard]]
+    inline ActiveCubeList find_active_cubes() const
+    {
+        return find_active_cubes({ glm::uvec3(0u), m_dimensions - 1u });
+    }
+
+    // Same as Volume::find_active_cubes, rows are gathered from the bricks before being classified.
+    [[nodiscard]]
+    inline ActiveCubeList find_active_cubes(const SampleRegion& region) const
+    {
+        TRAP_GE(region.max.x, m_dimensions.x, "Region out of bounds.");
+        TRAP_GE(region.max.y, m_dimensions.y, "Region out of bounds.");
+        TRAP_GE(region.max.z, m_dimensions.z, "Region out of bounds.");
+
+        if( region.empty() || is_one_sided(region) )
+        {
+            return { };
+        }
+
+        const glm::uvec3 size = region.get_size();
+        const uint32_t rowWords = get_row_mask_words(size.x);
+
+        std::vector<T> row(size.x);
+        return find_active_cubes_by_plane(region, [&](uint32_t z, uint64_t* planeMask)
+            {
+                for( uint32_t y = 0; y < size.y; y++ )
+                {
+                    read_row(region.min + glm::uvec3(0u, y, z), size.x, row.data());
+                    classify_row(row.data(), size.x, m_threshold, planeMask + static_cast<size_t>(y) * rowWords);
+                }
+            });
+    }
+
+    // Linear falloff when easeFunc is null.
+    inline void add_local_sphere(glm::vec3 position, float radius, float multiplier, bool multithread = false, float(*easeFunc)(float) = nullptr)
+    {
+        Brush brush = Brush::create_sphere(position, radius, BrushOperation::ADD, multiplier);
+        brush.easeFunc = easeFunc;
+        apply_brushes(&brush, 1, multithread);
+    }
+
+    inline void apply_brush(const Brush& brush, bool multithread = false)
+    {
+        apply_brushes(&brush, 1, multithread);
+    }
+
+    // Same as Volume::apply_brushes but walks the touched bricks, expanding uniform bricks before they are edited
+    // and collapsing them again if every sample ends up with the same value. Bricks are independent so with
+    // multithread set large batches are split across the job system one brick per job.
+    inline void apply_brushes(const Brush* brushes, size_t brushCount, bool multithread = false)
+    {
+        apply_brushes(brushes, brushCount, { glm::uvec3(0u), m_dimensions - 1u }, multithread);
+    }
+
+    // Only samples within limit are modified, samples outside it are still read by BLUR.
+    inline void apply_brushes(const Brush* brushes, size_t brushCount, const SampleRegion& limit, bool multithread = false)
+    {
+        BrushBatch<T> batch(brushes, brushCount, m_dimensions, m_minValue, m_maxValue, m_threshold);
+        batch.clip(limit);
+
+        const SampleRegion& region = batch.get_region();
+        if( region.empty() )
+        {
+            return;
+        }
+
+        m_dirtyRegion.expand_to_fit(region);
+
+        batch.capture_snapshot([&](glm::uvec3 first, uint32_t count, T* out)
+            {
+                read_row(first, count, out);
+            });
+
+        glm::uvec3 firstBrick = region.min / s_brickSize;
+        glm::uvec3 brickRange = region.max / s_brickSize - firstBrick + 1u;
+
+        auto editBrick = [&](glm::uvec3 brickLocation)
+            {
+                glm::uvec3 brickOrigin = brickLocation * s_brickSize;
+
+                SampleRegion edit{ glm::max(region.min, brickOrigin), glm::min(region.max, brickOrigin + (s_brickSize - 1u)) };
+
+                Brick& brick = m_bricks[get_brick_index(brickLocation)];
+                if( brick.samples.empty() )
+                {
+                    brick.samples.assign(s_brickSamples, brick.value);
+                }
+
+                float distances[s_brickSize];
+                for( uint32_t z = edit.min.z; z <= edit.max.z; z++ )
+                {
+                    for( uint32_t y = edit.min.y; y <= edit.max.y; y++ )
+                    {
+                        glm::uvec3 first{ edit.min.x, y, z };
+                        batch.apply_row(first, edit.max.x, brick.samples.data() + get_brick_sample_index(first - brickOrigin), distances);
+                    }
+                }
+
+                try_collapse(brick, brickOrigin);
+            };
+
+        auto editBricks = [&](const DispatchRange3d& bricks)
+            {
+                for( uint32_t z = bricks.begin.z; z < bricks.end.z; z++ )
+                {
+                    for( uint32_t y = bricks.begin.y; y < bricks.end.y; y++ )
+                    {
+                        for( uint32_t x = bricks.begin.x; x < bricks.end.x; x++ )
+                        {
+                            editBrick({ x, y, z });
+                        }
+                    }
+                }
+            };
+
+        DispatchRange3d bricks{ firstBrick, firstBrick + brickRange };
+        glm::uvec3 size = region.get_size();
+        if( multithread && static_cast<size_t>(size.x) * size.y * size.z >= s_parallelBrushSamples )
+        {
+            JobDispatch::parallel_for(bricks, glm::uvec3(1u), editBricks);
+        }
+        else
+        {
+            editBricks(bricks);
+        }
+    }
+
+    inline glm::uvec3 get_dimensions() const
+    {
+        return m_dimensions;
+    }
+
+    // Copies count samples of the row starting at first, spanning as many bricks as needed.
+    inline void read_row(glm::uvec3 first, uint32_t count, T* out) const
+    {
+        TRAP_GT(first.x + count, m_dimensions.x, "Row out of bounds.");
+
+        uint32_t x = first.x;
+        uint32_t end = first.x + count;
+        while( x < end )
+        {
+            glm::uvec3 loc{ x, first.y, first.z };
+            uint32_t spanEnd = std::min(end, (x / s_brickSize + 1u) * s_brickSize);
+            uint32_t span = spanEnd - x;
+
+            const Brick& brick = m_bricks[get_brick_index(loc / s_brickSize)];
+            if( brick.samples.empty() )
+            {
+                std::fill(out, out + span, brick.value);
+            }
+            else
+            {
+                const T* samples = brick.samples.data() + get_brick_sample_index(loc % s_brickSize);
+                std::copy(samples, samples + span, out);
+            }
+
+            out += span;
+            x = spanEnd;
+        }
+    }
+
+    // Overwrites count samples of the row starting at first, only the samples which change are marked dirty.
+    // Bricks left holding a single value are collapsed.
+    inline void write_row(glm::uvec3 first, uint32_t count, const T* in)
+    {
+        TRAP_GT(first.x + count, m_dimensions.x, "Row out of bounds.");
+
+        uint32_t x = first.x;
+        uint32_t end = first.x + count;
+        while( x < end )
+        {
+            glm::uvec3 loc{ x, first.y, first.z };
+            uint32_t spanEnd = std::min(end, (x / s_brickSize + 1u) * s_brickSize);
+            uint32_t span = spanEnd - x;
+
+            glm::uvec3 brickLocation = loc / s_brickSize;
+            Brick& brick = m_bricks[get_brick_index(brickLocation)];
+
+            const T* spanIn = in + (x - first.x);
+            if( brick.samples.empty() )
+            {
+                if( std::all_of(spanIn, spanIn + span, [&brick](T sample) { return sample == brick.value; }) )
+                {
+                    x = spanEnd;
+                    continue;
+                }
+
+                brick.samples.assign(s_brickSamples, brick.value);
+            }
+
+            T* samples = brick.samples.data() + get_brick_sample_index(loc % s_brickSize);
+            auto [samplesEnd, inEnd] = std::mismatch(samples, samples + span, spanIn);
+            if( samplesEnd != samples + span )
+            {
+                uint32_t firstChanged = static_cast<uint32_t>(samplesEnd - samples);
+                uint32_t lastChanged = span - 1;
+                while( samples[lastChanged] == spanIn[lastChanged] )
+                {
+                    lastChanged--;
+                }
+
+                std::copy(spanIn + firstChanged, spanIn + lastChanged + 1, samples + firstChanged);
+                m_dirtyRegion.expand_to_fit({ loc + glm::uvec3(firstChanged, 0u, 0u), loc + glm::uvec3(lastChanged, 0u, 0u) });
+                try_collapse(brick, brickLocation * s_brickSize);
+            }
+
+            x = spanEnd;
+        }
+    }
+
+    inline const SampleRegion& get_dirty_region() const
+    {
+        return m_dirtyRegion;
+    }
+
+    inline void clear_dirty_region()
+    {
+        m_dirtyRegion = {};
+    }
+
+    inline void mark_dirty(const SampleRegion& region)
+    {
+        m_dirtyRegion.expand_to_fit(region);
+    }
+
+    inline glm::vec3 get_edge_vertex(glm::uvec3 edgeOrigin, uint32_t axis, bool interpolate) const
+    {
+        float edgeInterp{ 0.5f };
+        if( interpolate )
+        {
+            glm::uvec3 edgeEnd = edgeOrigin;
+            edgeEnd[axis]++;
+            edgeInterp = inverse_lerp(m_threshold, get_sample(edgeOrigin), get_sample(edgeEnd));
+        }
+
+        glm::vec3 position(edgeOrigin);
+        position[axis] += edgeInterp;
+        return position / glm::vec3(m_dimensions - 1u);
+    }
+
+    inline glm::vec3 get_cube_edge_vertex(glm::uvec3 cubeOrigin, uint8_t edgeIndex, bool interpolate) const
+    {
+        LookupData* lookup = LookupData::instance();
+        return get_edge_vertex(cubeOrigin + lookup->get_edge_origin(edgeIndex), lookup->get_edge_axis(edgeIndex), interpolate);
+    }
+
+    // See Volume::get_edge_normal.
+    inline glm::vec3 get_edge_normal(glm::uvec3 edgeOrigin, uint32_t axis, bool interpolate) const
+    {
+        glm::uvec3 edgeEnd = edgeOrigin;
+        edgeEnd[axis]++;
+
+        float edgeInterp{ 0.5f };
+        if( interpolate )
+        {
+            edgeInterp = inverse_lerp(m_threshold, get_sample(edgeOrigin), get_sample(edgeEnd));
+        }
+
+        return get_surface_normal(glm::mix(get_gradient(edgeOrigin), get_gradient(edgeEnd), edgeInterp), axis, get_sample(edgeOrigin) > m_threshold);
+    }
+
+    inline T get_sample(glm::uvec3 loc) const
+    {
+        TRAP_GE(loc.x, m_dimensions.x, "Index out of bounds.");
+        TRAP_GE(loc.y, m_dimensions.y, "Index out of bounds.");
+        TRAP_GE(loc.z, m_dimensions.z, "Index out of bounds.");
+
+        const Brick& brick = m_bricks[get_brick_index(loc / s_brickSize)];
+        if( brick.samples.empty() )
+        {
+            return brick.value;
+        }
+        return brick.samples[get_brick_sample_index(loc % s_brickSize)];
+    }
+
+    // Bricks holding a sample per voxel, the rest are collapsed to a single value.
+    inline size_t get_dense_brick_count() const
+    {
+        return std::count_if(m_bricks.begin(), m_bricks.end(), [](const Brick& brick) { return !brick.samples.empty(); });
+    }
+
+    inline size_t get_memory_usage() const
+    {
+        return m_bricks.size() * sizeof(Brick) + get_dense_brick_count() * s_brickSamples * sizeof(T);
+    }
+
+    static constexpr uint32_t get_brick_size()
+    {
+        return s_brickSize;
+    }
+
+    // Appends the samples to out brick by brick, uniform bricks are written as their single value.
+    inline void serialize(std::vector<uint8_t>& out) const
+    {
+        write_bytes(out, m_dimensions);
+        write_bytes(out, s_brickSize);
+
+        for( const Brick& brick : m_bricks )
+        {
+            uint8_t dense = !brick.samples.empty();
+            write_bytes(out, dense);
+            if( dense )
+            {
+                const uint8_t* bytes = reinterpret_cast<const uint8_t*>(brick.samples.data());
+                out.insert(out.end(), bytes, bytes + s_brickSamples * sizeof(T));
+            }
+            else
+            {
+                write_bytes(out, brick.value);
+            }
+        }
+    }
+
+    // Replaces the samples with ones written by serialize. Returns false, leaving the volume untouched, if
+    // data is truncated or was written for different dimensions. The whole volume is marked dirty.
+    inline bool deserialize(const uint8_t* data, size_t size)
+    {
+        const uint8_t* end = data + size;
+
+        glm::uvec3 dimensions;
+        uint32_t brickSize;
+        if( !read_bytes(data, end, dimensions) || !read_bytes(data, end, brickSize)
+         || dimensions != m_dimensions || brickSize != s_brickSize )
+        {
+            return false;
+        }
+
+        std::vector<Brick> bricks(m_bricks.size());
+        for( Brick& brick : bricks )
+        {
+            uint8_t dense;
+            if( !read_bytes(data, end, dense) )
+            {
+                return false;
+            }
+
+            if( !dense )
+            {
+                if( !read_bytes(data, end, brick.value) )
+                {
+                    return false;
+                }
+                continue;
+            }
+
+            if( static_cast<size_t>(end - data) < s_brickSamples * sizeof(T) )
+            {
+                return false;
+            }
+
+            brick.samples.resize(s_brickSamples);
+            std::memcpy(brick.samples.data(), data, s_brickSamples * sizeof(T));
+            data += s_brickSamples * sizeof(T);
+        }
+
+        m_bricks = std::move(bricks);
+        mark_dirty({ glm::uvec3(0u), m_dimensions - 1u });
+        return true;
+    }
+private:
+    struct Brick
+    {
+        // Value of every sample while the brick is uniform.
+        T value;
+        // s_brickSamples samples in x, y, z order, empty while the brick is uniform.
+        std::vector<T> samples;
+    };
+
+    // True when every brick overlapping region is uniform and on the same side of the threshold, so no
+    // cube in the region can be crossed by the surface.
+    inline bool is_one_sided(const SampleRegion& region) const
+    {
+        glm::uvec3 firstBrick = region.min / s_brickSize;
+        glm::uvec3 lastBrick = region.max / s_brickSize;
+
+        const Brick& reference = m_bricks[get_brick_index(firstBrick)];
+        bool above = reference.value > m_threshold;
+
+        for( uint32_t z = firstBrick.z; z <= lastBrick.z; z++ )
+        {
+            for( uint32_t y = firstBrick.y; y <= lastBrick.y; y++ )
+            {
+                for( uint32_t x = firstBrick.x; x <= lastBrick.x; x++ )
+                {
+                    const Brick& brick = m_bricks[get_brick_index({ x, y, z })];
+                    if( !brick.samples.empty() || (brick.value > m_threshold) != above )
+                    {
+                        return false;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    // Collapses the brick if every sample inside the volume holds the same value, bricks on the upper
+    // edges of the volume can extend past it.
+    inline void try_collapse(Brick& brick, glm::uvec3 brickOrigin) const
+    {
+        glm::uvec3 extent = glm::min(m_dimensions - brickOrigin, glm::uvec3(s_brickSize));
+        T value = brick.samples.front();
+
+        for( uint32_t z = 0; z < extent.z; z++ )
+        {
+            for( uint32_t y = 0; y < extent.y; y++ )
+            {
+                const T* row = brick.samples.data() + get_brick_sample_index({ 0, y, z });
+                if( std::any_of(row, row + extent.x, [value](T sample) { return sample != value; }) )
+                {
+                    return;
+                }
+            }
+        }
+
+        brick.value = value;
+        brick.samples = {};
+    }
+
+    template<typename V>
+    static inline void write_bytes(std::vector<uint8_t>& out, const V& value)
+    {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+        out.insert(out.end(), bytes, bytes + sizeof(V));
+    }
+
+    template<typename V>
+    static inline bool read_bytes(const uint8_t*& data, const uint8_t* end, V& value)
+    {
+        if( static_cast<size_t>(end - data) < sizeof(V) )
+        {
+            return false;
+        }
+
+        std::memcpy(&value, data, sizeof(V));
+        data += sizeof(V);
+        return true;
+    }
+
+    // Central differences in volume space, one sided on the volume's faces.
+    inline glm::vec3 get_gradient(glm::uvec3 loc) const
+    {
+        glm::vec3 retval;
+        for( uint32_t axis = 0; axis < 3; axis++ )
+        {
+            glm::uvec3 lower = loc;
+            glm::uvec3 upper = loc;
+            lower[axis] -= lower[axis] > 0 ? 1 : 0;
+            upper[axis] += upper[axis] + 1 < m_dimensions[axis] ? 1 : 0;
+
+            float difference = static_cast<float>(get_sample(upper)) - static_cast<float>(get_sample(lower));
+            retval[axis] = difference / static_cast<float>(upper[axis] - lower[axis]) * static_cast<float>(m_dimensions[axis] - 1);
+        }
+        return retval;
+    }
+
+    inline size_t get_brick_index(glm::uvec3 brick) const
+    {
+        return brick.x + (brick.y + static_cast<size_t>(brick.z) * m_brickCounts.y) * m_brickCounts.x;
+    }
+
+    static inline size_t get_brick_sample_index(glm::uvec3 local)
+    {
+        return local.x + (local.y + local.z * s_brickSize) * s_brickSize;
+    }
+
+    inline float inverse_lerp(T threshold, T left, T right) const
+    {
+        float from = static_cast<float>(left);
+        return (static_cast<float>(threshold) - from) / (static_cast<float>(right) - from);
+    }
+private:
+    static constexpr uint32_t s_brickSize = 8;
+    static constexpr size_t s_brickSamples = s_brickSize * s_brickSize * s_brickSize;
+    static constexpr size_t s_parallelBrushSamples = 32 * 32 * 32;
+
+    T m_minValue;
+    T m_maxValue;
+    T m_threshold;
+    glm::uvec3 m_dimensions;
+    glm::uvec3 m_brickCounts;
+
+    std::vector<Brick> m_bricks;
+
+    SampleRegion m_dirtyRegion;
+};
+
+} // mcube
@@ -1,11 +1,15 @@
 #pragma once
 
 #include "pch/assert.h"
-#include "helpers/easing_functions.h"
 #include "LookupData.h"
+#include "Classify.h"
+#include "BrushBatch.h"
+#include "MipPyramid.h"
 #include "threading/JobDispatcher.h"
 
 #include <chrono>
+#include <numeric>
+#include <optional>
 
 namespace mcube
 {
@@ -23,6 +27,9 @@ enum CalculationFlagBits
     NORMALS = 1 << 1,
     MULTITHREADED = 1 << 2,
     NO_INTERPOLATION = 1 << 3,
+    SHARED_VERTICES = 1 << 4,
+    // Naive surface nets instead of marching cubes, see calculate_surface_nets. Vertices are always shared.
+    SURFACE_NETS = 1 << 5,
 
     ALL = MESH | NORMALS,
     ALL_MT = MESH | NORMALS | MULTITHREADED
@@ -30,16 +37,281 @@ enum CalculationFlagBits
 
 using CalculationFlags = std::underlying_type<CalculationFlagBits>::type;
 
-struct TriangleData
+struct ActiveCube
 {
-    std::vector<glm::vec3> vertices;
-    std::vector<glm::vec3> normals;
+    uint32_t x;
+    uint32_t y;
+    uint32_t z;
+    uint8_t state;
+    // Offset of the first index written by this cube, the running total of the triangle counts before it.
+    uint32_t firstIndex;
+};
+
+// Output of the counting pass, every cube the surface passes through in z, y, x order along with the
+// exact size of the mesh it will produce.
+struct ActiveCubeList
+{
+    std::vector<ActiveCube> cubes;
+    size_t indexCount{ 0 };
+    // Number of grid edges crossing the surface, the vertex count when vertices are shared.
+    size_t edgeCount{ 0 };
+};
+
+// Second half of the counting pass shared by the volume types, called for every sample plane z of region in
+// order. bottom holds the row masks of plane z and top those of plane z + 1, null for the last plane. Adds the
+// crossing edges starting in plane z and the active cubes of the cube layer between the two planes to list.
+inline void find_cubes_in_planes(const SampleRegion& region, uint32_t z, const uint64_t* bottom, const uint64_t* top,
+                                 ActiveCubeList& list)
+{
+    LookupData* lookup = LookupData::instance();
+
+    const glm::uvec3 size = region.get_size();
+    const uint32_t rowWords = get_row_mask_words(size.x);
+
+    // The last sample of each row has no x edge.
+    uint64_t lastWordEdges = size.x % 64u == 0
+        ? ~(uint64_t{ 1 } << 63)
+        : (uint64_t{ 1 } << ((size.x - 1u) % 64u)) - 1u;
+
+    for( uint32_t y = 0; y < size.y; y++ )
+    {
+        const uint64_t* b0 = bottom + y * rowWords;
+
+        for( uint32_t word = 0; word < rowWords; word++ )
+        {
+            uint64_t xEdges = b0[word] ^ get_next_sample_bits(b0, word, rowWords);
+            if( word + 1 == rowWords )
+            {
+                xEdges &= lastWordEdges;
+            }
+            list.edgeCount += std::popcount(xEdges);
+
+            if( y + 1 < size.y )
+            {
+                list.edgeCount += std::popcount(b0[word] ^ b0[word + rowWords]);
+            }
+
+            if( top )
+            {
+                list.edgeCount += std::popcount(b0[word] ^ top[y * rowWords + word]);
+            }
+        }
+
+        if( y + 1 == size.y || !top )
+        {
+            continue;
+        }
+
+        const uint64_t* t0 = top + y * rowWords;
+        for_each_active_cube(b0, b0 + rowWords, t0, t0 + rowWords, rowWords, size.x - 1,
+            [&](uint32_t x, uint8_t state)
+            {
+                list.cubes.push_back({ region.min.x + x, region.min.y + y, region.min.z + z, state, static_cast<uint32_t>(list.indexCount) });
+                list.indexCount += lookup->get_triangle_count(state) * 3u;
+            });
+    }
+}
+
+// Counting pass shared by the volume types. Sample planes are classified one at a time by
+// classifyPlane(z, planeMask) into zeroed row masks and swept in pairs, so only two planes of masks are held
+// at once whatever the size of region.
+template<typename ClassifyPlane>
+inline ActiveCubeList find_active_cubes_by_plane(const SampleRegion& region, const ClassifyPlane& classifyPlane)
+{
+    ActiveCubeList retval;
+
+    const glm::uvec3 size = region.get_size();
+    const size_t planeWords = static_cast<size_t>(get_row_mask_words(size.x)) * size.y;
+
+    std::vector<uint64_t> planes[2]{ std::vector<uint64_t>(planeWords, 0u), std::vector<uint64_t>(planeWords, 0u) };
+    classifyPlane(0u, planes[0].data());
+    for( uint32_t z = 0; z < size.z; z++ )
+    {
+        std::vector<uint64_t>& bottom = planes[z & 1u];
+        std::vector<uint64_t>& top = planes[(z + 1u) & 1u];
+
+        bool last = z + 1 == size.z;
+        if( !last )
+        {
+            std::fill(top.begin(), top.end(), 0u);
+            classifyPlane(z + 1u, top.data());
+        }
+
+        find_cubes_in_planes(region, z, bottom.data(), last ? nullptr : top.data(), retval);
+    }
+
+    return retval;
+}
+
+// Dual mesher shared by the volume types. Every active cube gets one vertex at the mean of the surface crossings
+// along its edges, or of the edge midpoints with NO_INTERPOLATION, and every grid edge crossing the surface is
+// joined by a quad between the vertices of the four cubes around it. The vertex count is the active cube count
+// and the result has about as many triangles as marching cubes for the same surface but roughly half the
+// vertices, every one shared, in a more regular layout.
+// Edges on the volume's boundary lack some of their cubes and produce no quad, the surface ends half a cube
+// inside the bounds. With MULTITHREADED the vertices are placed across the job system.
+template<typename VolumeType>
+inline MeshData calculate_surface_nets(const VolumeType& volume, const ActiveCubeList& activeCubes, CalculationFlags flags)
+{
+    LookupData* lookup = LookupData::instance();
+    bool interpolate = !static_cast<bool>(flags & CalculationFlagBits::NO_INTERPOLATION);
+
+    TRAP_GE(activeCubes.cubes.size(), static_cast<size_t>(std::numeric_limits<uint32_t>::max()), "Too many active cubes for 32 bit indices.");
+
+    bool normals = static_cast<bool>(flags & CalculationFlagBits::NORMALS);
+
+    MeshData retval;
+    retval.vertices.resize(activeCubes.cubes.size());
+    if( normals )
+    {
+        retval.normals.resize(activeCubes.cubes.size());
+    }
+
+    auto placeVertex = [&](size_t cubeIndex)
+        {
+            const ActiveCube& cube = activeCubes.cubes[cubeIndex];
+            glm::vec3 sum{ 0.f };
+            glm::vec3 normalSum{ 0.f };
+            uint32_t crossings{ 0 };
+            for( uint8_t edge = 0; edge < 12; edge++ )
+            {
+                auto [a, b] = lookup->get_corners_by_edge(edge);
+                if( ((cube.state >> a) & 1u) != ((cube.state >> b) & 1u) )
+                {
+                    glm::uvec3 edgeOrigin = glm::uvec3(cube.x, cube.y, cube.z) + lookup->get_edge_origin(edge);
+                    sum += volume.get_edge_vertex(edgeOrigin, lookup->get_edge_axis(edge), interpolate);
+                    if( normals )
+                    {
+                        normalSum += volume.get_edge_normal(edgeOrigin, lookup->get_edge_axis(edge), interpolate);
+                    }
+                    crossings++;
+                }
+            }
+            retval.vertices[cubeIndex] = sum / static_cast<float>(crossings);
+            if( normals )
+            {
+                float length = glm::length(normalSum);
+                retval.normals[cubeIndex] = length > 0.f ? normalSum / length : normalSum;
+            }
+        };
+
+    if( flags & CalculationFlagBits::MULTITHREADED )
+    {
+        JobDispatch::parallel_for(static_cast<uint32_t>(activeCubes.cubes.size()), 0,
+            [&](DispatchRange range)
+            {
+                for( uint32_t i = range.begin; i < range.end; i++ )
+                {
+                    placeVertex(i);
+                }
+            });
+    }
+    else
+    {
+        for( size_t i = 0; i < activeCubes.cubes.size(); i++ )
+        {
+            placeVertex(i);
+        }
+    }
+
+    // Cubes are ordered by z, y, x so the three cubes sharing an edge at a cube's lowest corner were all visited
+    // before it, in this cube layer or the one below. Only those two layers are indexed, a slot still holding
+    // a cube from an older layer of the same parity is told apart by its location.
+    const glm::uvec3 cubeCounts = volume.get_dimensions() - 1u;
+    const size_t layerSize = static_cast<size_t>(cubeCounts.x) * cubeCounts.y;
+    std::vector<uint32_t> layers[2]{ std::vector<uint32_t>(layerSize, 0u), std::vector<uint32_t>(layerSize, 0u) };
+
+    // Corner at the far end of the x, y and z edge starting at a cube's lowest corner.
+    constexpr uint8_t axisCorners[3]{ 1, 4, 3 };
+
+    for( size_t i = 0; i < activeCubes.cubes.size(); i++ )
+    {
+        const ActiveCube& cube = activeCubes.cubes[i];
+        layers[cube.z % 2][cube.x + static_cast<size_t>(cube.y) * cubeCounts.x] = static_cast<uint32_t>(i);
+
+        const glm::uvec3 origin{ cube.x, cube.y, cube.z };
+        for( uint32_t axis = 0; axis < 3; axis++ )
+        {
+            bool inside = cube.state & 1u;
+            if( inside == static_cast<bool>((cube.state >> axisCorners[axis]) & 1u) )
+            {
+                continue;
+            }
+
+            const uint32_t u = (axis + 1) % 3;
+            const uint32_t v = (axis + 2) % 3;
+            if( origin[u] == 0 || origin[v] == 0 )
+            {
+                continue;
+            }
+
+            auto getVertex = [&](uint32_t stepU, uint32_t stepV)
+                {
+                    glm::uvec3 loc = origin;
+                    loc[u] -= stepU;
+                    loc[v] -= stepV;
+                    uint32_t vertex = layers[loc.z % 2][loc.x + static_cast<size_t>(loc.y) * cubeCounts.x];
+                    const ActiveCube& neighbour = activeCubes.cubes[vertex];
+                    TRAP_NEQ(glm::uvec3(neighbour.x, neighbour.y, neighbour.z), loc, "Cube around a crossing edge is missing from the active cubes.");
+                    return vertex;
+                };
+
+            // Winding follows the marching cubes output, facing away from the inside.
+            uint32_t quad[4]{ static_cast<uint32_t>(i), getVertex(1, 0), getVertex(1, 1), getVertex(0, 1) };
+            if( !inside )
+            {
+                std::swap(quad[1], quad[3]);
+            }
+            retval.indices.insert(retval.indices.end(), { quad[0], quad[1], quad[2], quad[0], quad[2], quad[3] });
+        }
+    }
+
+    return retval;
+}
+
+// Normalized surface normal from an interpolated density gradient. The density rises into the inside so the
+// normal points down the gradient, a flat gradient falls back to the edge the crossing lies on.
+inline glm::vec3 get_surface_normal(glm::vec3 gradient, uint32_t edgeAxis, bool originInside)
+{
+    float length = glm::length(gradient);
+    if( length > 0.f )
+    {
+        return -gradient / length;
+    }
+
+    glm::vec3 retval{ 0.f };
+    retval[edgeAxis] = originInside ? 1.f : -1.f;
+    return retval;
+}
+
+// Range and threshold volumes are created with by default. Quantized volumes span their whole type with the
+// threshold at the midpoint, a 16 bit volume takes half the memory of a float one and an 8 bit volume a quarter.
+template<typename T>
+struct SampleTraits
+{
+    static_assert(std::is_integral_v<T> && std::is_unsigned_v<T>, "Quantized samples must be unsigned integers.");
+
+    static constexpr T minValue = std::numeric_limits<T>::min();
+    static constexpr T maxValue = std::numeric_limits<T>::max();
+    static constexpr T threshold = maxValue / 2;
+};
+
+template<>
+struct SampleTraits<float>
+{
+    static constexpr float minValue = 0.f;
+    static constexpr float maxValue = 1.f;
+    static constexpr float threshold = 0.5f;
 };
 
 template<typename T>
 class Volume
 {
 public:
+    explicit Volume(glm::uvec3 dimensions) :
+        Volume(dimensions, SampleTraits<T>::minValue, SampleTraits<T>::maxValue, SampleTraits<T>::threshold)
+    { }
+
     explicit Volume(glm::uvec3 dimensions, T minValue, T maxValue, T threshold) :
         m_data(dimensions.x * dimensions.y * dimensions.z, minValue),
         m_minValue(minValue),
@@ -54,164 +326,450 @@ public:
     ~Volume()
     { }
 
+    // Meshing is done in two phases. The first classifies every sample plane into row bitmasks and builds a
+    // compact list of the cubes the surface passes through, with a running total of their triangle counts.
+    // The second writes each active cube's triangles into buffers that were sized exactly up front, which with
+    // MULTITHREADED is split across the job system with every cube writing to its own range of the output.
     [[nodiscard]]
     inline MeshData calculate(CalculationFlags flags = MESH) const
     {
-        auto curtime = std::chrono::high_resolution_clock::now();
-
         TRAP_EQ(flags, 0, "Invalid flags set to calculate.");
-        TRAP_NEQ(flags & CalculationFlagBits::NORMALS, 0, "Normals is not yet supported.");
 
-        MeshData retval;
-        retval.vertices.reserve(
-            static_cast<size_t>(m_dimensions.x)
-            * static_cast<size_t>(m_dimensions.y)
-            * static_cast<size_t>(m_dimensions.z)
-            * 5u); // maximum 5 vertices per cube
+        ActiveCubeList activeCubes = find_active_cubes();
 
-        retval.indices.reserve(
-            retval.vertices.capacity());
+        if( flags & CalculationFlagBits::SURFACE_NETS )
+        {
+            return calculate_surface_nets(*this, activeCubes, flags);
+        }
 
-        if( flags & CalculationFlagBits::NORMALS )
+        if( flags & CalculationFlagBits::SHARED_VERTICES )
         {
-            retval.normals.reserve(
-                retval.vertices.capacity());
+            return calculate_shared(activeCubes, flags);
         }
 
-        if( flags & CalculationFlagBits::MULTITHREADED )
+        bool interpolate = !static_cast<bool>(flags & CalculationFlagBits::NO_INTERPOLATION);
+        bool normals = static_cast<bool>(flags & CalculationFlagBits::NORMALS);
+
+        MeshData retval;
+        retval.vertices.resize(activeCubes.indexCount);
+        retval.indices.resize(activeCubes.indexCount);
+        std::iota(retval.indices.begin(), retval.indices.end(), 0u);
+        if( normals )
         {
-            std::mutex addLock;
+            retval.normals.resize(activeCubes.indexCount);
+        }
 
-            auto perCubeJob = [=, &addLock, &retval](DispatchState state)
+        auto writeCube = [&](const ActiveCube& cube)
+            {
+                LookupData* lookup = LookupData::instance();
+                const std::array<int8_t, 16>& edges = lookup->get_edges_for_state(cube.state);
+                for( size_t edge = 0, vertex = cube.firstIndex; edges[edge] != -1; edge++, vertex++ )
                 {
-                    glm::uvec3 origin = index_to_loc(state.jobIndex);
-                    if( origin.x >= (m_dimensions.x - 1u) || origin.y >= (m_dimensions.y - 1u) || origin.z >= (m_dimensions.z - 1u) )
+                    uint8_t edgeIndex = static_cast<uint8_t>(edges[edge]);
+                    glm::uvec3 edgeOrigin = glm::uvec3(cube.x, cube.y, cube.z) + lookup->get_edge_origin(edgeIndex);
+                    retval.vertices[vertex] = get_edge_vertex(edgeOrigin, lookup->get_edge_axis(edgeIndex), interpolate);
+                    if( normals )
                     {
-                        return;
+                        retval.normals[vertex] = get_edge_normal(edgeOrigin, lookup->get_edge_axis(edgeIndex), interpolate);
                     }
+                }
+            };
 
-                    TriangleData data = get_cube_triangles(
-                        origin,
-                        get_edges(origin),
-                        static_cast<bool>(flags & CalculationFlagBits::NORMALS),
-                        !static_cast<bool>(flags & CalculationFlagBits::NO_INTERPOLATION));
+        if( flags & CalculationFlagBits::MULTITHREADED )
+        {
+            JobDispatch::parallel_for_each(activeCubes.cubes, 0, writeCube);
+        }
+        else
+        {
+            for( const ActiveCube& cube : activeCubes.cubes )
+            {
+                writeCube(cube);
+            }
+        }
 
-                    if( data.vertices.size() == 0 )
-                    {
-                        return;
-                    }
+        return retval;
+    }
+
+    // Counting pass of calculate. Each sample plane is thresholded once into row bitmasks (vectorized for
+    // float volumes), cube cases are assembled from neighbouring rows with bit operations so empty and solid
+    // cubes are skipped in bulk, and the triangle counts of the remaining cubes are accumulated from LookupData.
+    [[nodiscard]]
+    inline ActiveCubeList find_active_cubes() const
+    {
+        return find_active_cubes({ glm::uvec3(0u), m_dimensions - 1u });
+    }
+
+    // Counting pass restricted to the cubes whose corners all lie within region. Cube locations are
+    // still in volume space, the masks only cover the samples of the region. Only two sample planes of masks
+    // are held at a time, see find_active_cubes_by_plane.
+    [[nodiscard]]
+    inline ActiveCubeList find_active_cubes(const SampleRegion& region) const
+    {
+        TRAP_GE(region.max.x, m_dimensions.x, "Region out of bounds.");
+        TRAP_GE(region.max.y, m_dimensions.y, "Region out of bounds.");
+        TRAP_GE(region.max.z, m_dimensions.z, "Region out of bounds.");
+
+        if( region.empty() )
+        {
+            return { };
+        }
+
+        const glm::uvec3 size = region.get_size();
+        const uint32_t rowWords = get_row_mask_words(size.x);
+
+        // State of each row of level 0 cells crossing the current plane, see classify_cell_rows.
+        std::vector<CellRowState> cellRows;
+        uint32_t cellRowsZ{ std::numeric_limits<uint32_t>::max() };
+
+        return find_active_cubes_by_plane(region, [&](uint32_t z, uint64_t* planeMask)
+            {
+                if( m_mipPyramid && m_mipPyramid->get_cell_of_cube(0, region.min + glm::uvec3(0u, 0u, z)).z != cellRowsZ )
+                {
+                    cellRowsZ = m_mipPyramid->get_cell_of_cube(0, region.min + glm::uvec3(0u, 0u, z)).z;
+                    classify_cell_rows(region, cellRowsZ, cellRows);
+                }
+
+                for( uint32_t y = 0; y < size.y; y++ )
+                {
+                    glm::uvec3 first = region.min + glm::uvec3(0u, y, z);
+                    uint64_t* rowMask = planeMask + static_cast<size_t>(y) * rowWords;
 
-                    // These seem pretty similar performance wise but bottom one looks way cooler ngl.
-                #if 0
-                    std::lock_guard<std::mutex> lock(addLock);
-                    for( size_t i = 0; i < data.vertices.size(); i++ )
+                    CellRowState state = m_mipPyramid ? cellRows[m_mipPyramid->get_cell_of_cube(0, first).y] : CellRowState::STRADDLING;
+                    if( state == CellRowState::OUTSIDE )
                     {
-                        retval.vertices.push_back(data.vertices.at(i));
-                        retval.indices.push_back(static_cast<uint16_t>(retval.indices.size()));
-                        if( flags & CalculationFlagBits::NORMALS )
-                        {
-                            retval.normals.push_back(data.normals.at(i));
-                        }
+                        continue;
                     }
-                #else
-                    size_t beginIndex{ };
+                    else if( state == CellRowState::INSIDE )
                     {
-                        std::lock_guard<std::mutex> lock(addLock);
-                        beginIndex = retval.vertices.size();
-                        size_t size = beginIndex + data.vertices.size();
-
-                        retval.vertices.resize(size);
-                        retval.indices.resize(size);
-                        if( flags & CalculationFlagBits::NORMALS )
-                        {
-                            retval.normals.resize(size);
-                        }
+                        set_row_mask_bits(rowMask, 0, size.x);
                     }
-
-                    for( size_t i = 0; i < data.vertices.size(); i++ )
+                    else
                     {
-                        retval.vertices.at(beginIndex + i) = data.vertices.at(i);
-                        retval.indices.at(beginIndex + i) = static_cast<uint16_t>(beginIndex + i);
-                        if( flags & CalculationFlagBits::NORMALS )
-                        {
-                            retval.normals.at(beginIndex + i) = data.normals.at(i);
-                        }
+                        classify_row(m_data.data() + loc_to_index(first), size.x, m_threshold, rowMask);
                     }
-                #endif
-                };
+                }
+            });
+    }
 
-            uint32_t jobCount = m_dimensions.x * m_dimensions.y * m_dimensions.z;
-            JobDispatch::dispatch_and_wait(jobCount, 50, perCubeJob);
+    // Indexed version of calculate, every grid edge crossing the surface produces exactly one vertex
+    // which is shared by all of the triangles that use it.
+    // The active cubes are partitioned into slabs of s_slabLayers cube layers which are meshed independently,
+    // in parallel with MULTITHREADED, into their own vertex buffers. Indices are written straight into the
+    // final index buffer as slab local values and fixed up by a gather pass once every slab's vertex offset is
+    // known. Vertices on the plane between two slabs belong to the upper slab. The partition only depends on
+    // the volume so the output is identical regardless of thread count.
+    [[nodiscard]]
+    inline MeshData calculate_shared(const ActiveCubeList& activeCubes, CalculationFlags flags = MESH | SHARED_VERTICES) const
+    {
+        bool interpolate = !static_cast<bool>(flags & CalculationFlagBits::NO_INTERPOLATION);
+        bool normals = static_cast<bool>(flags & CalculationFlagBits::NORMALS);
+        bool multithreaded = static_cast<bool>(flags & CalculationFlagBits::MULTITHREADED);
+
+        MeshData retval;
+        retval.vertices.resize(activeCubes.edgeCount);
+        retval.indices.resize(activeCubes.indexCount);
+        if( normals )
+        {
+            retval.normals.resize(activeCubes.edgeCount);
         }
-        else
+
+        uint32_t layerCount = m_dimensions.z - 1;
+        uint32_t slabCount = (layerCount + s_slabLayers - 1) / s_slabLayers;
+
+        std::vector<SharedSlab> slabs(slabCount);
+        for( uint32_t i = 0; i < slabCount; i++ )
         {
-            for( uint32_t x = 0; x < m_dimensions.x - 1; x++ )
+            SharedSlab& slab = slabs[i];
+            slab.firstLayer = i * s_slabLayers;
+            slab.endLayer = std::min(slab.firstLayer + s_slabLayers, layerCount);
+
+            auto firstCube = std::lower_bound(activeCubes.cubes.begin(), activeCubes.cubes.end(), slab.firstLayer,
+                [](const ActiveCube& cube, uint32_t layer) { return cube.z < layer; });
+            auto endCube = std::lower_bound(firstCube, activeCubes.cubes.end(), slab.endLayer,
+                [](const ActiveCube& cube, uint32_t layer) { return cube.z < layer; });
+
+            slab.firstCube = static_cast<size_t>(firstCube - activeCubes.cubes.begin());
+            slab.endCube = static_cast<size_t>(endCube - activeCubes.cubes.begin());
+        }
+
+        auto meshSlab = [&](uint32_t slabIndex)
             {
-                for( uint32_t y = 0; y < m_dimensions.y - 1; y++ )
+                mesh_shared_slab(activeCubes, slabs[slabIndex], slabIndex + 1 == slabCount, interpolate, normals, retval.indices.data());
+            };
+
+        auto gatherSlab = [&](uint32_t slabIndex)
+            {
+                const SharedSlab& slab = slabs[slabIndex];
+                std::copy(slab.vertices.begin(), slab.vertices.end(), retval.vertices.begin() + slab.vertexOffset);
+                std::copy(slab.normals.begin(), slab.normals.end(), retval.normals.begin() + slab.vertexOffset);
+
+                if( slab.firstCube == slab.endCube )
                 {
-                    for( uint32_t z = 0; z < m_dimensions.z - 1; z++ )
+                    return;
+                }
+
+                size_t firstIndex = activeCubes.cubes[slab.firstCube].firstIndex;
+                size_t endIndex = slab.endCube < activeCubes.cubes.size()
+                    ? activeCubes.cubes[slab.endCube].firstIndex
+                    : activeCubes.indexCount;
+
+                for( size_t i = firstIndex; i < endIndex; i++ )
+                {
+                    uint32_t& index = retval.indices[i];
+                    if( index & s_foreignVertex )
+                    {
+                        // Owned by the bottom plane of the next slab.
+                        const SharedSlab& owner = slabs[slabIndex + 1];
+                        uint32_t key = index & ~s_foreignVertex;
+                        auto it = std::lower_bound(owner.bottomVertices.begin(), owner.bottomVertices.end(), key,
+                            [](const std::pair<uint32_t, uint32_t>& vertex, uint32_t value) { return vertex.first < value; });
+
+                        TRAP_EQ(it, owner.bottomVertices.end(), "Slab boundary vertex is missing from the owning slab.");
+                        index = static_cast<uint32_t>(owner.vertexOffset) + it->second;
+                    }
+                    else
                     {
-                        glm::uvec3 origin{ x, y, z };
-                        TriangleData data = get_cube_triangles(
-                            origin,
-                            get_edges(origin),
-                            static_cast<bool>(flags & CalculationFlagBits::NORMALS),
-                            !static_cast<bool>(flags & CalculationFlagBits::NO_INTERPOLATION));
-
-                        for( size_t i = 0; i < data.vertices.size(); i++ )
-                        {
-                            retval.indices.push_back(static_cast<uint32_t>(retval.indices.size()));
-                            retval.vertices.push_back(data.vertices.at(i));
-                            if( flags & CalculationFlagBits::NORMALS )
-                            {
-                                retval.normals.push_back(data.normals.at(i));
-                            }
-                        }
+                        index += static_cast<uint32_t>(slab.vertexOffset);
                     }
                 }
+            };
+
+        if( multithreaded )
+        {
+            JobDispatch::dispatch_and_wait(slabCount, 1, [&](DispatchState state) { meshSlab(state.jobIndex); });
+        }
+        else
+        {
+            for( uint32_t i = 0; i < slabCount; i++ )
+            {
+                meshSlab(i);
             }
         }
 
-        retval.vertices.shrink_to_fit();
-        retval.indices.shrink_to_fit();
-        if( flags & CalculationFlagBits::NORMALS )
+        size_t vertexOffset{ 0 };
+        for( SharedSlab& slab : slabs )
+        {
+            slab.vertexOffset = vertexOffset;
+            vertexOffset += slab.vertices.size();
+        }
+
+        TRAP_NEQ(vertexOffset, activeCubes.edgeCount, "Shared vertex count does not match the number of crossing edges.");
+
+        if( multithreaded )
         {
-            retval.normals.shrink_to_fit();
+            JobDispatch::dispatch_and_wait(slabCount, 1, [&](DispatchState state) { gatherSlab(state.jobIndex); });
+        }
+        else
+        {
+            for( uint32_t i = 0; i < slabCount; i++ )
+            {
+                gatherSlab(i);
+            }
         }
 
         return retval;
     }
 
-    inline void add_local_sphere(glm::vec3 position, float radius, float multiplier, bool multithread = false, float(*easeFunc)(float) = easing_function_linear)
+    // Linear falloff when easeFunc is null.
+    inline void add_local_sphere(glm::vec3 position, float radius, float multiplier, bool multithread = false, float(*easeFunc)(float) = nullptr)
     {
-        for( uint32_t x = 0; x < m_dimensions.x; x++ )
+        Brush brush = Brush::create_sphere(position, radius, BrushOperation::ADD, multiplier);
+        brush.easeFunc = easeFunc;
+        apply_brushes(&brush, 1, multithread);
+    }
+
+    inline void apply_brush(const Brush& brush, bool multithread = false)
+    {
+        apply_brushes(&brush, 1, multithread);
+    }
+
+    // Applies a batch of local space brushes in order within a single pass over the union of their bounds, see
+    // BrushBatch. The cost follows the brush sizes rather than the volume size.
+    // With multithread set, batches covering at least s_parallelBrushSamples samples are split across the job
+    // system in blocks of whole rows.
+    inline void apply_brushes(const Brush* brushes, size_t brushCount, bool multithread = false)
+    {
+        apply_brushes(brushes, brushCount, { glm::uvec3(0u), m_dimensions - 1u }, multithread);
+    }
+
+    // Only samples within limit are modified, samples outside it are still read by BLUR.
+    inline void apply_brushes(const Brush* brushes, size_t brushCount, const SampleRegion& limit, bool multithread = false)
+    {
+        BrushBatch<T> batch(brushes, brushCount, m_dimensions, m_minValue, m_maxValue, m_threshold);
+        batch.clip(limit);
+
+        const SampleRegion& region = batch.get_region();
+        if( region.empty() )
         {
-            for( uint32_t y = 0; y < m_dimensions.y; y++ )
+            return;
+        }
+
+        m_dirtyRegion.expand_to_fit(region);
+
+        batch.capture_snapshot([&](glm::uvec3 first, uint32_t count, T* out)
+            {
+                read_row(first, count, out);
+            });
+
+        auto rasterize = [&](const DispatchRange3d& rows)
             {
-                for( uint32_t z = 0; z < m_dimensions.z; z++ )
+                std::vector<float> distances(rows.size().x);
+
+                for( uint32_t z = rows.begin.z; z < rows.end.z; z++ )
                 {
-                    glm::uvec3 location{ x, y, z };
-                    glm::vec3 localPos = loc_to_local(location);
-                    float distance = glm::distance(localPos, position);
-                    if( distance > radius )
+                    for( uint32_t y = rows.begin.y; y < rows.end.y; y++ )
                     {
-                        continue;
+                        glm::uvec3 first{ rows.begin.x, y, z };
+                        batch.apply_row(first, rows.end.x - 1u, m_data.data() + loc_to_index(first), distances.data());
                     }
-                    float percent = 1.f - (distance / radius);
-
-                    T currentValue = at(location);
-                    T rawDiff = static_cast<T>(m_minValue + ((m_maxValue - m_minValue) * easeFunc(percent)));
-                    set(location, std::clamp(static_cast<T>(currentValue + (rawDiff * multiplier)), m_minValue, m_maxValue));
                 }
-            }
+            };
+
+        DispatchRange3d rows{ region.min, region.max + 1u };
+        glm::uvec3 size = region.get_size();
+        if( multithread && static_cast<size_t>(size.x) * size.y * size.z >= s_parallelBrushSamples )
+        {
+            JobDispatch::parallel_for(rows, rasterize);
+        }
+        else
+        {
+            rasterize(rows);
+        }
+
+        update_mip_pyramid(region);
+    }
+
+    // Maintains a MipPyramid of the samples from now on, kept up to date by every edit. Counting passes then
+    // skip reading the sample rows which lie entirely within cells on one side of the threshold.
+    inline void set_mip_pyramid_enabled(bool enabled)
+    {
+        if( !enabled )
+        {
+            m_mipPyramid.reset();
         }
+        else if( !m_mipPyramid )
+        {
+            m_mipPyramid.emplace(m_dimensions);
+            update_mip_pyramid({ glm::uvec3(0u), m_dimensions - 1u });
+        }
+    }
+
+    // Null unless enabled with set_mip_pyramid_enabled.
+    inline const MipPyramid<T>* get_mip_pyramid() const
+    {
+        return m_mipPyramid ? &*m_mipPyramid : nullptr;
     }
 
     inline glm::uvec3 get_dimensions() const
     {
         return m_dimensions;
     }
+
+    inline void read_row(glm::uvec3 first, uint32_t count, T* out) const
+    {
+        TRAP_GT(first.x + count, m_dimensions.x, "Row out of bounds.");
+        const T* row = m_data.data() + loc_to_index(first);
+        std::copy(row, row + count, out);
+    }
+
+    // Overwrites count samples of the row starting at first, only the samples which change are marked dirty.
+    inline void write_row(glm::uvec3 first, uint32_t count, const T* in)
+    {
+        TRAP_GT(first.x + count, m_dimensions.x, "Row out of bounds.");
+        T* row = m_data.data() + loc_to_index(first);
+
+        auto [rowEnd, inEnd] = std::mismatch(row, row + count, in);
+        if( rowEnd == row + count )
+        {
+            return;
+        }
+
+        uint32_t firstChanged = static_cast<uint32_t>(rowEnd - row);
+        uint32_t lastChanged = count - 1;
+        while( row[lastChanged] == in[lastChanged] )
+        {
+            lastChanged--;
+        }
+
+        std::copy(in + firstChanged, in + lastChanged + 1, row + firstChanged);
+
+        SampleRegion changed{ first + glm::uvec3(firstChanged, 0u, 0u), first + glm::uvec3(lastChanged, 0u, 0u) };
+        m_dirtyRegion.expand_to_fit(changed);
+        update_mip_pyramid(changed);
+    }
+
+    // Samples modified since the dirty region was last cleared, consumers remesh from this and
+    // then clear it.
+    inline const SampleRegion& get_dirty_region() const
+    {
+        return m_dirtyRegion;
+    }
+
+    inline void clear_dirty_region()
+    {
+        m_dirtyRegion = {};
+    }
+
+    inline void mark_dirty(const SampleRegion& region)
+    {
+        m_dirtyRegion.expand_to_fit(region);
+    }
+
+    // Surface crossing along a grid edge, edgeOrigin is the lowest sample of the edge.
+    inline glm::vec3 get_edge_vertex(glm::uvec3 edgeOrigin, uint32_t axis, bool interpolate) const
+    {
+        float edgeInterp{ 0.5f };
+        if( interpolate )
+        {
+            const size_t strides[3]{ 1, m_dimensions.x, static_cast<size_t>(m_dimensions.x) * m_dimensions.y };
+            const T* sample = m_data.data() + edgeOrigin.x + edgeOrigin.y * strides[1] + edgeOrigin.z * strides[2];
+            edgeInterp = inverse_lerp(m_threshold, sample[0], sample[strides[axis]]);
+        }
+
+        glm::vec3 position(edgeOrigin);
+        position[axis] += edgeInterp;
+        return position / glm::vec3(m_dimensions - 1u);
+    }
+
+    inline glm::vec3 get_cube_edge_vertex(glm::uvec3 cubeOrigin, uint8_t edgeIndex, bool interpolate) const
+    {
+        LookupData* lookup = LookupData::instance();
+        return get_edge_vertex(cubeOrigin + lookup->get_edge_origin(edgeIndex), lookup->get_edge_axis(edgeIndex), interpolate);
+    }
+
+    // Surface normal at the crossing along a grid edge, the density gradients at both samples of the edge
+    // interpolated the same way as get_edge_vertex and pointing out of the inside.
+    inline glm::vec3 get_edge_normal(glm::uvec3 edgeOrigin, uint32_t axis, bool interpolate) const
+    {
+        glm::uvec3 edgeEnd = edgeOrigin;
+        edgeEnd[axis]++;
+
+        float edgeInterp{ 0.5f };
+        if( interpolate )
+        {
+            edgeInterp = inverse_lerp(m_threshold, at(edgeOrigin), at(edgeEnd));
+        }
+
+        return get_surface_normal(glm::mix(get_gradient(edgeOrigin), get_gradient(edgeEnd), edgeInterp), axis, at(edgeOrigin) > m_threshold);
+    }
 private:
+    // Central differences in volume space, one sided on the volume's faces.
+    inline glm::vec3 get_gradient(glm::uvec3 loc) const
+    {
+        glm::vec3 retval;
+        for( uint32_t axis = 0; axis < 3; axis++ )
+        {
+            glm::uvec3 lower = loc;
+            glm::uvec3 upper = loc;
+            lower[axis] -= lower[axis] > 0 ? 1 : 0;
+            upper[axis] += upper[axis] + 1 < m_dimensions[axis] ? 1 : 0;
+
+            float difference = static_cast<float>(at(upper)) - static_cast<float>(at(lower));
+            retval[axis] = difference / static_cast<float>(upper[axis] - lower[axis]) * static_cast<float>(m_dimensions[axis] - 1);
+        }
+        return retval;
+    }
+
     inline T& at(glm::uvec3 loc)
     {
         size_t index = loc_to_index(loc);
@@ -254,107 +812,194 @@ private:
         return retval;
     }
 
-    inline glm::vec3 loc_to_local(glm::uvec3 loc) const
+    inline void update_mip_pyramid(const SampleRegion& region)
     {
-        return {
-            loc.x / static_cast<float>(m_dimensions.x - 1),
-            loc.y / static_cast<float>(m_dimensions.y - 1),
-            loc.z / static_cast<float>(m_dimensions.z - 1)
-        };
+        if( m_mipPyramid )
+        {
+            m_mipPyramid->update(region, [this](glm::uvec3 first, uint32_t count, T* out)
+                {
+                    read_row(first, count, out);
+                });
+        }
     }
 
-    inline const std::array<int8_t, 16>& get_edges(glm::uvec3 origin) const
+    // How the samples of a row of level 0 cells along x relate to the threshold.
+    enum class CellRowState : uint8_t
     {
-        LookupData* lookup = LookupData::instance();
+        OUTSIDE,
+        INSIDE,
+        // Neighbouring cells share their face samples, so a row which is neither all inside nor all outside
+        // always holds a cell crossing the threshold.
+        STRADDLING
+    };
+
+    // Classifies every row of level 0 cells in the plane of cells cellZ, limited to the cells overlapping region
+    // along x, so the counting pass skips or fills the masks of whole sample rows without reading them.
+    inline void classify_cell_rows(const SampleRegion& region, uint32_t cellZ, std::vector<CellRowState>& out) const
+    {
+        const glm::uvec3 counts = m_mipPyramid->get_cell_counts(0);
+        const uint32_t firstX = m_mipPyramid->get_cell_of_cube(0, region.min).x;
+        const uint32_t lastX = m_mipPyramid->get_cell_of_cube(0, region.max).x;
 
-        // get corner state
-        uint8_t cornerState{ 0 };
-        for( uint32_t corner = 0; corner < 8; corner++ )
+        out.resize(counts.y);
+        for( uint32_t y = 0; y < counts.y; y++ )
         {
-            glm::uvec3 offset = lookup->get_corner_offset(corner);
-            glm::uvec3 cornerPoint{ origin.x + offset.x, origin.y + offset.y, origin.z + offset.z };
-
-            if( at(cornerPoint) > m_threshold )
+            uint32_t inside{ 0 };
+            uint32_t outside{ 0 };
+            for( uint32_t x = firstX; x <= lastX; x++ )
             {
-                cornerState |= (1 << corner);
+                const typename MipPyramid<T>::Cell& cell = m_mipPyramid->get_cell(0, { x, y, cellZ });
+                inside += cell.min > m_threshold;
+                outside += cell.max <= m_threshold;
             }
-        }
 
-        return lookup->get_edges_for_state(cornerState);
+            uint32_t cellCount = lastX - firstX + 1;
+            out[y] = outside == cellCount ? CellRowState::OUTSIDE
+                : inside == cellCount ? CellRowState::INSIDE
+                : CellRowState::STRADDLING;
+        }
     }
 
-    inline TriangleData get_cube_triangles(glm::uvec3 origin, const std::array<int8_t, 16>& edges, bool calculateNormals, bool interpolate) const
+    inline glm::vec3 loc_to_local(glm::uvec3 loc) const
     {
-        LookupData* lookup = LookupData::instance();
-        TriangleData retval{ };
+        return {
+            loc.x / static_cast<float>(m_dimensions.x - 1),
+            loc.y / static_cast<float>(m_dimensions.y - 1),
+            loc.z / static_cast<float>(m_dimensions.z - 1)
+        };
+    }
 
-        for( size_t edge = 0; edge < 16; edge += 3 )
+    struct SharedSlab
+    {
+        uint32_t firstLayer{ 0 };
+        uint32_t endLayer{ 0 };
+        size_t firstCube{ 0 };
+        size_t endCube{ 0 };
+
+        std::vector<glm::vec3> vertices;
+        // Empty unless meshing with NORMALS.
+        std::vector<glm::vec3> normals;
+        // Plane edge key and local index of each vertex on the bottom plane, sorted by key so
+        // the slab below can resolve the vertices it shares.
+        std::vector<std::pair<uint32_t, uint32_t>> bottomVertices;
+        size_t vertexOffset{ 0 };
+    };
+
+    // Meshes one slab of active cubes into its own vertex buffer, writing slab local indices into the
+    // slab's range of indexOut. Vertices on the top plane of the slab are left to the slab above unless
+    // this is the last one, those indices are written as s_foreignVertex | plane edge key instead.
+    // Vertex indices are looked up through per slice edge caches so only the planes of the current
+    // cube layer are cached at once.
+    inline void mesh_shared_slab(const ActiveCubeList& activeCubes, SharedSlab& slab, bool ownsTopPlane, bool interpolate, bool normals, uint32_t* indexOut) const
+    {
+        if( slab.firstCube == slab.endCube )
         {
-            if( edges[edge] == -1 )
-            {
-                break;
-            }
+            return;
+        }
+
+        LookupData* lookup = LookupData::instance();
 
-            std::pair<uint8_t, uint8_t> eA = lookup->get_corners_by_edge(edges[edge]);
-            std::pair<uint8_t, uint8_t> eB = lookup->get_corners_by_edge(edges[edge + 1]);
-            std::pair<uint8_t, uint8_t> eC = lookup->get_corners_by_edge(edges[edge + 2]);
+        const size_t rowSize = m_dimensions.x;
+        const size_t planeSize = rowSize * m_dimensions.y;
 
-            // edge A
-            glm::uvec3 eAvA = origin + lookup->get_corner_offset(eA.first);
-            glm::uvec3 eAvB = origin + lookup->get_corner_offset(eA.second);
+        // x and y edges lying on the bottom and top plane of the current cube layer, z edges joining them.
+        std::vector<uint32_t> bottomCache(planeSize * 2, s_invalidVertex);
+        std::vector<uint32_t> topCache(planeSize * 2, s_invalidVertex);
+        std::vector<uint32_t> verticalCache(planeSize, s_invalidVertex);
 
-            glm::vec3 eAVertex{ };
-            float edgeInterp = interpolate
-                ? inverse_lerp(m_threshold, at(eAvA), at(eAvB))
-                : 0.5f;
+        indexOut += activeCubes.cubes[slab.firstCube].firstIndex;
+        uint32_t layer = slab.firstLayer;
 
-            eAVertex = lerp_points(loc_to_local(eAvA), loc_to_local(eAvB), edgeInterp);
+        for( size_t cubeIndex = slab.firstCube; cubeIndex < slab.endCube; cubeIndex++ )
+        {
+            const ActiveCube& cube = activeCubes.cubes[cubeIndex];
 
-            // edge B
-            glm::uvec3 eBvA = origin + lookup->get_corner_offset(eB.first);
-            glm::uvec3 eBvB = origin + lookup->get_corner_offset(eB.second);
+            // The top of the previous layer is the bottom of this one.
+            for( ; layer < cube.z; layer++ )
+            {
+                if( layer + 1 == cube.z )
+                {
+                    std::swap(bottomCache, topCache);
+                }
+                else
+                {
+                    std::fill(bottomCache.begin(), bottomCache.end(), s_invalidVertex);
+                }
+                std::fill(topCache.begin(), topCache.end(), s_invalidVertex);
+                std::fill(verticalCache.begin(), verticalCache.end(), s_invalidVertex);
+            }
 
-            glm::vec3 eBVertex{ };
-            edgeInterp = interpolate
-                ? inverse_lerp(m_threshold, at(eBvA), at(eBvB))
-                : 0.5f;
+            const std::array<int8_t, 16>& edges = lookup->get_edges_for_state(cube.state);
+            for( size_t edge = 0; edges[edge] != -1; edge++ )
+            {
+                uint8_t edgeIndex = static_cast<uint8_t>(edges[edge]);
+                glm::uvec3 edgeOrigin = glm::uvec3(cube.x, cube.y, cube.z) + lookup->get_edge_origin(edgeIndex);
+                uint32_t axis = lookup->get_edge_axis(edgeIndex);
 
-            eBVertex = lerp_points(loc_to_local(eBvA), loc_to_local(eBvB), edgeInterp);
+                size_t planeIndex = edgeOrigin.x + edgeOrigin.y * rowSize;
+                uint32_t key = static_cast<uint32_t>(planeIndex * 2 + axis);
 
-            // edge C
-            glm::uvec3 eCvA = origin + lookup->get_corner_offset(eC.first);
-            glm::uvec3 eCvB = origin + lookup->get_corner_offset(eC.second);
+                uint32_t* cached{ nullptr };
+                if( axis == 2 )
+                {
+                    cached = &verticalCache[planeIndex];
+                }
+                else if( edgeOrigin.z == cube.z )
+                {
+                    cached = &bottomCache[key];
+                }
+                else if( edgeOrigin.z < slab.endLayer || ownsTopPlane )
+                {
+                    cached = &topCache[key];
+                }
+                else
+                {
+                    *indexOut++ = s_foreignVertex | key;
+                    continue;
+                }
 
-            glm::vec3 eCVertex{ };
-            edgeInterp = interpolate
-                ? inverse_lerp(m_threshold, at(eCvA), at(eCvB))
-                : 0.5f;
+                if( *cached == s_invalidVertex )
+                {
+                    *cached = static_cast<uint32_t>(slab.vertices.size());
+                    slab.vertices.push_back(get_edge_vertex(edgeOrigin, axis, interpolate));
+                    if( normals )
+                    {
+                        slab.normals.push_back(get_edge_normal(edgeOrigin, axis, interpolate));
+                    }
 
-            eCVertex = lerp_points(loc_to_local(eCvA), loc_to_local(eCvB), edgeInterp);
+                    if( axis != 2 && edgeOrigin.z == slab.firstLayer )
+                    {
+                        slab.bottomVertices.emplace_back(key, *cached);
+                    }
+                }
 
-            retval.vertices.push_back(eAVertex);
-            retval.vertices.push_back(eBVertex);
-            retval.vertices.push_back(eCVertex);
+                *indexOut++ = *cached;
+            }
         }
 
-        return retval;
+        std::sort(slab.bottomVertices.begin(), slab.bottomVertices.end());
     }
 
+    // Operands are converted before subtracting so unsigned samples below the threshold don't wrap.
     inline float inverse_lerp(T threshold, T left, T right) const
     {
-        return static_cast<float>(threshold - left) / (right - left);
-    }
-
-    inline glm::vec3 lerp_points(glm::vec3 a, glm::vec3 b, float value) const
-    {
-        return a + ((b - a) * value);
+        float from = static_cast<float>(left);
+        return (static_cast<float>(threshold) - from) / (static_cast<float>(right) - from);
     }
 private:
+    static constexpr uint32_t s_invalidVertex = std::numeric_limits<uint32_t>::max();
+    static constexpr uint32_t s_foreignVertex = 1u << 31;
+    static constexpr uint32_t s_slabLayers = 8;
+    static constexpr size_t s_parallelBrushSamples = 32 * 32 * 32;
+
     mtl::fixed_vector<T> m_data;
+    std::optional<MipPyramid<T>> m_mipPyramid;
     T m_minValue;
     T m_maxValue;
     T m_threshold;
     glm::uvec3 m_dimensions;
+
+    SampleRegion m_dirtyRegion;
 };
 
 } // mcube
\ No newline at end of file
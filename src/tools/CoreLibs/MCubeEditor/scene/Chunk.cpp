@@ -10,12 +10,13 @@ PARAM(marching_cube_resolution);
 Chunk::Chunk(Scene* scene, std::string name, glm::vec3 origin, glm::vec3 size) :
     SceneObject(scene),
     m_name(name),
+    m_origin(origin),
     m_size(size)
 {
     Blueprint bp(m_name);
     m_blueprint = bp.get_id();
 
-    Blueprint* blueprint = get_scene()->request_create_blueprint(std::move(bp));
+    get_scene()->request_create_blueprint(std::move(bp));
 
     Entity ent(m_blueprint);
     m_entity = ent.get_id();
@@ -23,9 +24,8 @@ Chunk::Chunk(Scene* scene, std::string name, glm::vec3 origin, glm::vec3 size) :
     entity->transform().position() = origin;
     entity->transform().scale() = m_size;
 
-    create_data_backed_volume();
+    create_data_backed_volume(get_resolution());
     m_colour = { (rand() % 255) / 255.f, (rand() % 255) / 255.f, (rand() % 255) / 255.f };
-    set_mesh_to_volume(blueprint);
 }
 
 Chunk::~Chunk()
@@ -34,6 +34,16 @@ Chunk::~Chunk()
     get_scene()->request_destroy_blueprint(m_blueprint);
 }
 
+uint32_t Chunk::get_resolution()
+{
+    uint32_t resolution = DEFAULT_MARCHING_CUBE_RESOLUTION;
+    if( Param_marching_cube_resolution.get() )
+    {
+        Param_marching_cube_resolution.get_int((int*) &resolution);
+    }
+    return resolution;
+}
+
 Mesh* Chunk::mesh() const
 {
     Blueprint* blueprint = get_scene()->get_blueprint(m_blueprint);
@@ -54,24 +64,198 @@ Transform* Chunk::transform() const
     return nullptr;
 }
 
-void Chunk::sphere_edit(glm::vec3 pos, float radius, float deltaTime, bool addition)
+ChunkVolume* Chunk::volume() const
+{
+    return m_volume.get();
+}
+
+bool Chunk::apply_brushes(const std::vector<mcube::Brush>& brushes, const mcube::SampleRegion& limit)
 {
     if( !m_volume )
     {
         // No volume set to edit
-        return;
+        return false;
     }
 
-    if( !get_bounds().contains(pos, radius) )
+    AABoundingBox<float> bounds = get_bounds();
+
+    std::vector<mcube::Brush> localBrushes;
+    for( const mcube::Brush& brush : brushes )
     {
-        // no influence
-        return;
+        if( !bounds.intersects(brush.get_bounds()) )
+        {
+            // no influence
+            continue;
+        }
+
+        localBrushes.push_back(to_local(brush));
     }
 
-    // transform sphere to local
-    m_volume->add_local_sphere((pos - get_origin()) / m_size, radius / m_size.x, deltaTime * 10.f * (addition ? 1.f : -1.f), g_useMultithreading);
+    if( localBrushes.empty() )
+    {
+        return false;
+    }
 
-    set_mesh_to_volume();
+    m_volume->apply_brushes(localBrushes.data(), localBrushes.size(), limit, g_useMultithreading);
+    return true;
+}
+
+bool Chunk::remesh()
+{
+    Mesh* bpmesh = mesh();
+    if( !m_volume || !bpmesh )
+    {
+        // Blueprint is still in the scene's creation queue
+        return !m_volume;
+    }
+
+    if( m_volume->get_dirty_region().empty() && m_generation != 0 && !m_detailChanged )
+    {
+        return true;
+    }
+
+    if( m_remeshTasks.size() >= s_maxRemeshTasks )
+    {
+        return false;
+    }
+
+    m_simplified = false;
+    m_lastRemesh = std::chrono::steady_clock::now();
+    submit_remesh(0.f);
+    return true;
+}
+
+bool Chunk::simplify(float maxError, double idleSeconds)
+{
+    if( !m_volume || !mesh() || m_simplified || m_generation == 0 || !m_remeshTasks.empty() )
+    {
+        return false;
+    }
+
+    // Pending edits get a regular remesh first, the chunk is only idle once they were published.
+    if( !m_volume->get_dirty_region().empty() || m_detailChanged )
+    {
+        return false;
+    }
+
+    if( std::chrono::steady_clock::now() - m_lastRemesh < std::chrono::duration<double>(idleSeconds) )
+    {
+        return false;
+    }
+
+    m_simplified = true;
+    submit_remesh(maxError / static_cast<float>(m_volume->get_dimensions().x - 1));
+    return true;
+}
+
+void Chunk::submit_remesh(float simplifyError)
+{
+    Mesh* bpmesh = mesh();
+    std::shared_ptr<RemeshTask> task = std::make_shared<RemeshTask>(*m_volume, bpmesh->get_vertex_buffer_count());
+    task->generation = ++m_generation;
+    task->submitted = m_volume->get_dirty_region();
+    task->flags = get_calculation_flags();
+    task->colour = m_colour;
+    task->lod = m_lod;
+    task->skirtFaces = m_skirtFaces;
+    // A simplified mesh differs from the published one even where no brick changed.
+    task->rebuild = m_detailChanged || simplifyError > 0.f;
+    task->simplifyError = simplifyError;
+    if( m_lod == 0 )
+    {
+        // Shares the published brick meshes, the task only allocates the bricks it regenerates.
+        task->bricked = std::make_unique<mcube::BrickedMesh<ChunkSample, ChunkVolume>>(m_volumeMesh->share());
+    }
+    m_detailChanged = false;
+
+    m_unpublishedRegion.expand_to_fit(task->submitted);
+    m_volume->clear_dirty_region();
+
+    // The copied mesh bricks match the published mesh so the task remeshes everything since then.
+    task->volume.clear_dirty_region();
+    task->volume.mark_dirty(m_unpublishedRegion);
+
+    m_remeshTasks.push_back(task);
+
+    if( g_useMultithreading )
+    {
+        task->job = JobDispatch::execute_background([task]()
+            {
+                run_remesh_task(*task);
+            });
+    }
+    else
+    {
+        run_remesh_task(*task);
+        publish_remesh();
+    }
+}
+
+bool Chunk::publish_remesh()
+{
+    std::shared_ptr<RemeshTask> newest;
+    for( const std::shared_ptr<RemeshTask>& task : m_remeshTasks )
+    {
+        if( task->job.is_done() && (!newest || task->generation > newest->generation) )
+        {
+            newest = task;
+        }
+    }
+
+    if( newest && newest->generation > m_publishedGeneration )
+    {
+        Mesh* bpmesh = mesh();
+        if( newest->changed && bpmesh )
+        {
+            *bpmesh = std::move(newest->mesh);
+        }
+
+        if( newest->bricked )
+        {
+            m_volumeMesh = std::move(newest->bricked);
+        }
+        else
+        {
+            // The bricks no longer match the published mesh, returning to full detail remeshes every brick.
+            m_volumeMesh = std::make_unique<mcube::BrickedMesh<ChunkSample, ChunkVolume>>(m_volume->get_dimensions(), ChunkVolume::get_brick_size());
+        }
+        m_publishedGeneration = newest->generation;
+
+        m_unpublishedRegion = {};
+        for( const std::shared_ptr<RemeshTask>& task : m_remeshTasks )
+        {
+            if( task->generation > m_publishedGeneration )
+            {
+                m_unpublishedRegion.expand_to_fit(task->submitted);
+            }
+        }
+    }
+
+    // Finished tasks are either published or stale by now.
+    std::erase_if(m_remeshTasks, [](const std::shared_ptr<RemeshTask>& task)
+        {
+            return task->job.is_done();
+        });
+
+    return !m_remeshTasks.empty();
+}
+
+bool Chunk::set_detail(uint32_t lod, mcube::SkirtFaces skirtFaces)
+{
+    if( lod == m_lod && skirtFaces == m_skirtFaces )
+    {
+        return false;
+    }
+
+    m_lod = lod;
+    m_skirtFaces = skirtFaces;
+    m_detailChanged = true;
+    return true;
+}
+
+uint32_t Chunk::get_lod() const
+{
+    return m_lod;
 }
 
 AABoundingBox<float> Chunk::get_bounds() const
@@ -82,7 +266,8 @@ AABoundingBox<float> Chunk::get_bounds() const
 
 glm::vec3 Chunk::get_origin() const
 {
-    return transform()->position();
+    // Not read from the entity, which only exists once the scene resolves its creation queue.
+    return m_origin;
 }
 
 glm::vec3 Chunk::get_centre() const
@@ -99,66 +284,121 @@ void Chunk::create_data_backed_volume(uint32_t resolution)
         return;
     }
 
-    m_volume = std::make_unique<mcube::Volume<float>>(dimensions, 0.f, 1.f, 0.5f);
-    m_currentResolution = resolution;
+    set_volume(std::make_unique<ChunkVolume>(dimensions));
 }
 
-void Chunk::set_mesh_to_volume(Blueprint* blueprint)
+void Chunk::set_volume(std::unique_ptr<ChunkVolume> volume)
 {
-    if( !m_volume )
+    glm::uvec3 dimensions = volume->get_dimensions();
+
+    // Mesh bricks line up with the storage bricks so uniform storage bricks skip meshing entirely.
+    m_volume = std::move(volume);
+    m_volumeMesh = std::make_unique<mcube::BrickedMesh<ChunkSample, ChunkVolume>>(dimensions, ChunkVolume::get_brick_size());
+    m_currentResolution = dimensions.x;
+
+    // Remeshes still in flight were built from the previous volume.
+    m_publishedGeneration = m_generation;
+    m_unpublishedRegion = {};
+    m_volume->mark_dirty({ glm::uvec3(0u), dimensions - 1u });
+}
+
+std::unique_ptr<ChunkVolume> Chunk::release_volume()
+{
+    m_volumeMesh.reset();
+    m_publishedGeneration = m_generation;
+    return std::move(m_volume);
+}
+
+mcube::CalculationFlags Chunk::get_calculation_flags() const
+{
+    // Remeshing already runs as one job per chunk, dispatching the bricks as well would have jobs
+    // waiting on jobs.
+    mcube::CalculationFlags flags = mcube::CalculationFlagBits::MESH | mcube::CalculationFlagBits::NORMALS | mcube::CalculationFlagBits::SHARED_VERTICES;
+    if( Param_disable_marching_cube_interpolation.get() )
     {
-        return;
+        flags |= mcube::CalculationFlagBits::NO_INTERPOLATION;
     }
+    return flags;
+}
 
-    Mesh* bpmesh = nullptr;
-    if( blueprint )
+void Chunk::run_remesh_task(RemeshTask& task)
+{
+    mcube::MeshData lodData;
+    const mcube::MeshData* source = &lodData;
+
+    if( task.bricked )
     {
-        bpmesh = &blueprint->mesh();
+        // Only the bricks touched since the published mesh are regenerated.
+        task.changed = task.bricked->update(task.volume, task.flags) || task.rebuild;
+        source = &task.bricked->get_mesh();
     }
     else
     {
-        bpmesh = mesh();
+        ChunkVolume lodVolume(mcube::get_lod_dimensions(task.volume.get_dimensions(), task.lod));
+        mcube::downsample<ChunkSample, ChunkVolume>(task.volume, lodVolume);
+        lodData = lodVolume.calculate(task.flags);
+        task.changed = true;
     }
 
-    if( !bpmesh )
+    if( task.changed )
     {
-        return;
-    }
+        // The bricked mesh is kept as meshed for the next incremental update.
+        mcube::MeshData processed;
+        if( task.simplifyError > 0.f || task.skirtFaces )
+        {
+            processed = *source;
+            source = &processed;
+        }
 
-    mcube::CalculationFlags flags = mcube::CalculationFlagBits::MESH;
-    if( Param_disable_marching_cube_interpolation.get() )
-    {
-        flags |= mcube::CalculationFlagBits::NO_INTERPOLATION;
-    }
-    if( g_useMultithreading )
-    {
-        flags |= mcube::CalculationFlagBits::MULTITHREADED;
-    }
-    mcube::MeshData data = m_volume->calculate(flags);
-    std::vector<Vertex> vertices;
-    vertices.reserve(data.vertices.size());
+        if( task.simplifyError > 0.f )
+        {
+            // Before the skirts, which hang off border vertices simplify keeps in place.
+            mcube::simplify(processed, task.simplifyError);
+        }
 
-    for( size_t i = 0; i < data.vertices.size(); i++ )
-    {
-        if( flags & mcube::CalculationFlagBits::NORMALS )
+        if( task.skirtFaces )
         {
-            vertices.push_back({ data.vertices.at(i), data.normals.at(i), m_colour });
+            // Deep enough to cover the crack towards a neighbour one level coarser.
+            glm::vec3 cubes = glm::vec3(mcube::get_lod_dimensions(task.volume.get_dimensions(), task.lod) - 1u);
+            mcube::add_skirts(processed, task.skirtFaces, 2.f / std::min({ cubes.x, cubes.y, cubes.z }));
         }
-        else
+
+        const mcube::MeshData& data = *source;
+        std::vector<Vertex> vertices;
+        vertices.reserve(data.vertices.size());
+
+        for( size_t i = 0; i < data.vertices.size(); i++ )
         {
-            vertices.push_back({ data.vertices.at(i), { 0.f, 0.f, 0.f }, m_colour });
+            if( task.flags & mcube::CalculationFlagBits::NORMALS )
+            {
+                vertices.push_back({ data.vertices.at(i), data.normals.at(i), task.colour });
+            }
+            else
+            {
+                vertices.push_back({ data.vertices.at(i), { 0.f, 0.f, 0.f }, task.colour });
+            }
         }
-    }
 
-    bpmesh->set_vertices(vertices, 0);
+        task.mesh.set_vertices(vertices, 0);
 
-    std::vector<uint16_t> indices;
-    indices.reserve(data.indices.size());
-    for( size_t i = 0; i < data.indices.size(); i++ )
-    {
-        indices.push_back(data.indices.at(i));
+        TRAP_GT(data.vertices.size(), std::numeric_limits<uint16_t>::max(), "Too many vertices for 16 bit indices.");
+
+        std::vector<uint16_t> indices;
+        indices.reserve(data.indices.size());
+        for( size_t i = 0; i < data.indices.size(); i++ )
+        {
+            indices.push_back(static_cast<uint16_t>(data.indices.at(i)));
+        }
+
+        task.mesh.set_indices(indices);
     }
+}
 
-    bpmesh->set_indices(indices);
-    bpmesh->recalculate_normals();
+mcube::Brush Chunk::to_local(const mcube::Brush& brush) const
+{
+    mcube::Brush retval = brush;
+    retval.position = (brush.position - get_origin()) / m_size;
+    retval.extents = brush.extents / m_size.x;
+    retval.smoothness = brush.smoothness / m_size.x;
+    return retval;
 }
\ No newline at end of file
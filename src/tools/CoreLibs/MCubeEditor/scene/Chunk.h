@@ -4,13 +4,21 @@
 #include "scene/gameplay/Entity.h"
 #include "SceneObject.h"
 
-#include "mcube/Volume.h"
+#include "mcube/SparseVolume.h"
+#include "mcube/Lod.h"
+#include "mcube/Simplify.h"
+#include "threading/JobHandle.h"
 
 #define DEFAULT_MARCHING_CUBE_RESOLUTION 16
 #define DEFAULT_MARCHING_CUBE_THRESHOLD 0.5
 
 extern bool g_useMultithreading;
 
+// Chunk densities are quantized to a byte per sample, a quarter of the memory of float samples.
+using ChunkSample = uint8_t;
+// Chunks are mostly empty or solid space, bricks away from the surface collapse to a single value.
+using ChunkVolume = mcube::SparseVolume<ChunkSample>;
+
 class Chunk : public SceneObject
 {
 public:
@@ -21,11 +29,42 @@ public:
     Chunk& operator=(const Chunk&) = delete;
 
     ~Chunk();
+
+    // Samples per axis of every chunk volume.
+    static uint32_t get_resolution();
     
     Mesh* mesh() const;
     Transform* transform() const;
+    ChunkVolume* volume() const;
+
+    // Replaces the chunk's samples, used when paging a chunk back in. Remeshes in flight are dropped.
+    void set_volume(std::unique_ptr<ChunkVolume> volume);
+    // Moves the samples out of the chunk, leaving it without a volume, used when paging a chunk out.
+    std::unique_ptr<ChunkVolume> release_volume();
+
+    // Applies world space brushes overlapping the chunk in a single pass, only samples within limit are modified.
+    // Returns true if any brush overlapped the chunk, the mesh is left for remesh.
+    bool apply_brushes(const std::vector<mcube::Brush>& brushes, const mcube::SampleRegion& limit);
 
-    void sphere_edit(glm::vec3 pos, float radius, float deltaTime, bool addition);
+    // Remeshes the samples modified since the last remesh. With multithreading the work runs as a background
+    // job and the chunk keeps its current mesh until publish_remesh swaps the result in. Returns false if the
+    // remesh has to be retried, when the mesh does not exist yet or too many remeshes are already in flight.
+    bool remesh();
+
+    // Swaps in the newest finished remesh in one step, results older than the published mesh were superseded
+    // by a later edit and are dropped. Returns true while remeshes are still in flight.
+    bool publish_remesh();
+
+    // Remeshes the chunk once more with mcube::simplify when nothing was remeshed for idleSeconds, maxError is
+    // in cubes. The simplified mesh stays until the next edit or change of detail. Returns true if the remesh
+    // was submitted.
+    bool simplify(float maxError, double idleSeconds);
+
+    // Meshes the chunk from its volume downsampled lod times, see mcube::get_lod_dimensions, with skirts on
+    // skirtFaces to cover the cracks towards neighbours at another level. Returns true if either changed, the
+    // chunk then needs a full remesh.
+    bool set_detail(uint32_t lod, mcube::SkirtFaces skirtFaces);
+    uint32_t get_lod() const;
 
     AABoundingBox<float> get_bounds() const;
 
@@ -34,15 +73,70 @@ public:
 private:
     void create_data_backed_volume(uint32_t resolution = DEFAULT_MARCHING_CUBE_RESOLUTION);
 
-    void set_mesh_to_volume(Blueprint* blueprint = nullptr);
+    mcube::CalculationFlags get_calculation_flags() const;
+
+    // Submits a remesh of everything modified since the published mesh, simplified if simplifyError is set.
+    void submit_remesh(float simplifyError);
+
+    mcube::Brush to_local(const mcube::Brush& brush) const;
+private:
+    // Everything a remesh needs, so the job never touches the chunk and a result can be dropped along
+    // with the chunk while it is still running.
+    struct RemeshTask
+    {
+        RemeshTask(const ChunkVolume& volume, uint32_t vertexBufferCount) :
+            volume(volume),
+            mesh(vertexBufferCount)
+        { }
+
+        uint64_t generation{ 0 };
+        // Samples modified between the previous submit and this one.
+        mcube::SampleRegion submitted;
+
+        // Copies taken at submit, the volume's dirty region covers everything since the published mesh.
+        ChunkVolume volume;
+        // Only meshed in bricks at full detail, other levels are small enough to mesh whole.
+        std::unique_ptr<mcube::BrickedMesh<ChunkSample, ChunkVolume>> bricked;
+        mcube::CalculationFlags flags{ 0 };
+        glm::vec3 colour{ 0.f };
+        uint32_t lod{ 0 };
+        mcube::SkirtFaces skirtFaces{ 0 };
+        // Set when the detail changed since the previous submit, the mesh is rebuilt even if no brick is.
+        bool rebuild{ false };
+        // Maximum error of mcube::simplify in volume space, zero leaves the mesh as meshed.
+        float simplifyError{ 0.f };
+
+        Mesh mesh;
+        bool changed{ false };
+        // Done once the results above are written, empty when the task ran on the submitting thread.
+        JobHandle job;
+    };
+
+    static void run_remesh_task(RemeshTask& task);
 private:
+    static constexpr size_t s_maxRemeshTasks = 2;
+
     std::string m_name;
     bpid_t m_blueprint{ 0 };
     entid_t m_entity{ 0 };
 
-    std::unique_ptr<mcube::Volume<float>> m_volume;
+    std::unique_ptr<ChunkVolume> m_volume;
+    std::unique_ptr<mcube::BrickedMesh<ChunkSample, ChunkVolume>> m_volumeMesh;
+    glm::vec3 m_origin;
     glm::vec3 m_size;
     glm::vec3 m_colour;
 
     uint32_t m_currentResolution{ 0 };
+    uint32_t m_lod{ 0 };
+    mcube::SkirtFaces m_skirtFaces{ 0 };
+    bool m_detailChanged{ false };
+    // Whether the newest submitted remesh simplifies, and when the last remesh which did not was submitted.
+    bool m_simplified{ false };
+    std::chrono::steady_clock::time_point m_lastRemesh;
+
+    std::vector<std::shared_ptr<RemeshTask>> m_remeshTasks;
+    uint64_t m_generation{ 0 };
+    uint64_t m_publishedGeneration{ 0 };
+    // Samples modified since the volume the published mesh was built from.
+    mcube::SampleRegion m_unpublishedRegion;
 };
\ No newline at end of file
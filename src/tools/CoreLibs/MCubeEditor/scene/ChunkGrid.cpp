@@ -0,0 +1,456 @@
+#include "ChunkGrid.h"
+
+#define DEFAULT_REMESH_BUDGET_MS 2.0
+PARAM(remesh_budget_ms);
+// Distance from the camera where chunks drop to half detail, zero keeps every chunk at full detail.
+#define DEFAULT_LOD_DISTANCE 30.f
+PARAM(lod_distance);
+// Error in cubes up to which chunks left alone for chunk_simplify_idle_seconds are simplified, zero disables it.
+#define DEFAULT_CHUNK_SIMPLIFY_ERROR 0.25f
+#define DEFAULT_CHUNK_SIMPLIFY_IDLE_SECONDS 5.0
+PARAM(chunk_simplify_error);
+PARAM(chunk_simplify_idle_seconds);
+
+// Offsets of the neighbours above a chunk, ordered by the number of axes they are offset along so the first
+// existing chunk found for a shared sample is the one which owns it, see ChunkGrid::get_owner.
+static constexpr std::array<glm::ivec3, 7> s_upperNeighbours{
+    glm::ivec3{ 1, 1, 1 },
+    glm::ivec3{ 1, 1, 0 },
+    glm::ivec3{ 1, 0, 1 },
+    glm::ivec3{ 0, 1, 1 },
+    glm::ivec3{ 1, 0, 0 },
+    glm::ivec3{ 0, 1, 0 },
+    glm::ivec3{ 0, 0, 1 },
+};
+
+// Samples of a chunk on its first layer along the axes where side is -1, on its last layer where it is 1 and
+// strictly between the two where it is 0.
+static mcube::SampleRegion get_side_region(uint32_t resolution, glm::ivec3 side)
+{
+    mcube::SampleRegion retval{ glm::uvec3(1u), glm::uvec3(resolution - 2) };
+    for( uint32_t axis = 0; axis < 3; axis++ )
+    {
+        if( side[axis] != 0 )
+        {
+            retval.min[axis] = side[axis] > 0 ? resolution - 1 : 0;
+            retval.max[axis] = retval.min[axis];
+        }
+    }
+    return retval;
+}
+
+// Calls fn(side) for every group of samples a chunk shares with its neighbours, see get_side_region.
+template<typename Fn>
+static void for_each_side(Fn&& fn)
+{
+    for( int z = -1; z <= 1; z++ )
+    {
+        for( int y = -1; y <= 1; y++ )
+        {
+            for( int x = -1; x <= 1; x++ )
+            {
+                if( x != 0 || y != 0 || z != 0 )
+                {
+                    fn(glm::ivec3{ x, y, z });
+                }
+            }
+        }
+    }
+}
+
+static void copy_samples(const ChunkVolume& source, const mcube::SampleRegion& sourceRegion, ChunkVolume& destination, glm::uvec3 destinationMin)
+{
+    glm::uvec3 size = sourceRegion.get_size();
+    std::vector<ChunkSample> row(size.x);
+
+    for( uint32_t z = 0; z < size.z; z++ )
+    {
+        for( uint32_t y = 0; y < size.y; y++ )
+        {
+            glm::uvec3 offset{ 0u, y, z };
+            source.read_row(sourceRegion.min + offset, size.x, row.data());
+            destination.write_row(destinationMin + offset, size.x, row.data());
+        }
+    }
+}
+
+// Conservative test of world space bounds against the clip space of viewProjection, bounds are only
+// rejected when every corner is outside the same side plane or behind the camera.
+static bool is_visible(const glm::mat4& viewProjection, const AABoundingBox<float>& bounds)
+{
+    uint32_t outside[5]{ 0 };
+    for( uint32_t corner = 0; corner < 8; corner++ )
+    {
+        glm::vec3 position{
+            corner & 1 ? bounds.max.x : bounds.min.x,
+            corner & 2 ? bounds.max.y : bounds.min.y,
+            corner & 4 ? bounds.max.z : bounds.min.z };
+
+        glm::vec4 clip = viewProjection * glm::vec4(position, 1.f);
+        outside[0] += clip.x < -clip.w;
+        outside[1] += clip.x > clip.w;
+        outside[2] += clip.y < -clip.w;
+        outside[3] += clip.y > clip.w;
+        outside[4] += clip.w <= 0.f;
+    }
+
+    return std::none_of(std::begin(outside), std::end(outside), [](uint32_t count) { return count == 8; });
+}
+
+ChunkGrid::ChunkGrid(Scene* scene, glm::vec3 chunkSize) :
+    m_scene(scene),
+    m_chunkSize(chunkSize),
+    m_remeshBudgetMs(DEFAULT_REMESH_BUDGET_MS),
+    m_lodDistance(DEFAULT_LOD_DISTANCE),
+    m_simplifyError(DEFAULT_CHUNK_SIMPLIFY_ERROR),
+    m_simplifyIdleSeconds(DEFAULT_CHUNK_SIMPLIFY_IDLE_SECONDS)
+{
+    Param_remesh_budget_ms.get_double(&m_remeshBudgetMs);
+    Param_lod_distance.get_float(&m_lodDistance);
+    Param_chunk_simplify_error.get_float(&m_simplifyError);
+    Param_chunk_simplify_idle_seconds.get_double(&m_simplifyIdleSeconds);
+}
+
+ChunkGrid::~ChunkGrid()
+{ }
+
+Chunk* ChunkGrid::create_chunk(glm::ivec3 index, std::unique_ptr<ChunkVolume> volume)
+{
+    if( Chunk* existing = get_chunk(index) )
+    {
+        return existing;
+    }
+
+    glm::vec3 origin = glm::vec3(index) * m_chunkSize;
+
+    auto inserted = m_chunks.insert(std::pair(index,
+        std::make_unique<Chunk>(m_scene, std::format("chunk:{}-{}-{}", index.x, index.y, index.z), origin, m_chunkSize)));
+
+    if( volume )
+    {
+        inserted.first->second->set_volume(std::move(volume));
+    }
+
+    // Samples edited while this chunk did not exist live in the chunks around it, once they are copied in the
+    // new chunk owns them. Ownership of samples the new chunk does not hold can move as well, a chunk on the
+    // diagonal can take over a line shared by two of its neighbours, so every neighbour is synced again.
+    seed_from_neighbours(index);
+    for_each_neighbour(index, [this](glm::ivec3 neighbour)
+        {
+            sync_apron(neighbour);
+            m_dirtyChunks.insert(neighbour);
+        });
+
+    return inserted.first->second.get();
+}
+
+std::unique_ptr<ChunkVolume> ChunkGrid::destroy_chunk(glm::ivec3 index)
+{
+    auto it = m_chunks.find(index);
+    if( it == m_chunks.end() )
+    {
+        return nullptr;
+    }
+
+    std::unique_ptr<ChunkVolume> retval = it->second->release_volume();
+    m_chunks.erase(it);
+    m_dirtyChunks.erase(index);
+    m_remeshingChunks.erase(index);
+    return retval;
+}
+
+Chunk* ChunkGrid::get_chunk(glm::ivec3 index) const
+{
+    auto it = m_chunks.find(index);
+    if( it != m_chunks.end() )
+    {
+        return it->second.get();
+    }
+    return nullptr;
+}
+
+size_t ChunkGrid::get_chunk_count() const
+{
+    return m_chunks.size();
+}
+
+glm::vec3 ChunkGrid::get_chunk_size() const
+{
+    return m_chunkSize;
+}
+
+glm::ivec3 ChunkGrid::get_chunk_index(glm::vec3 position) const
+{
+    return glm::ivec3(glm::floor(position / m_chunkSize));
+}
+
+void ChunkGrid::apply_brushes(const std::vector<mcube::Brush>& brushes)
+{
+    if( brushes.empty() )
+    {
+        return;
+    }
+
+    std::unordered_set<glm::ivec3> touched;
+    for( const mcube::Brush& brush : brushes )
+    {
+        for_each_chunk_in_bounds(brush.get_bounds(), [&touched](glm::ivec3 index, Chunk&)
+            {
+                touched.insert(index);
+            });
+    }
+
+    std::unordered_set<glm::ivec3> staleAprons;
+    for( glm::ivec3 index : touched )
+    {
+        Chunk* chunk = get_chunk(index);
+        uint32_t resolution = chunk->volume()->get_dimensions().x;
+        if( !chunk->apply_brushes(brushes, get_owned_region(index, resolution)) )
+        {
+            continue;
+        }
+
+        // The edit also wrote the few samples within the owned region which belong to a diagonal neighbour,
+        // syncing the chunk itself puts the owner's values back.
+        m_dirtyChunks.insert(index);
+        for_each_neighbour(index, [&staleAprons](glm::ivec3 neighbour)
+            {
+                staleAprons.insert(neighbour);
+            });
+    }
+
+    for( glm::ivec3 index : staleAprons )
+    {
+        sync_apron(index);
+        m_dirtyChunks.insert(index);
+    }
+}
+
+void ChunkGrid::update(const Camera& camera)
+{
+    auto begin = std::chrono::high_resolution_clock::now();
+
+    for( auto it = m_remeshingChunks.begin(); it != m_remeshingChunks.end(); )
+    {
+        Chunk* chunk = get_chunk(*it);
+        if( !chunk || !chunk->publish_remesh() )
+        {
+            it = m_remeshingChunks.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    glm::vec3 eye = camera.get_position();
+    update_detail(eye);
+
+    // Hidden chunks sort after every visible chunk, then nearest first.
+    glm::mat4 viewProjection = camera.as_projection_matrix() * camera.as_view_matrix();
+
+    std::vector<std::tuple<bool, float, glm::ivec3>> queue;
+    queue.reserve(m_dirtyChunks.size());
+    for( glm::ivec3 index : m_dirtyChunks )
+    {
+        if( Chunk* chunk = get_chunk(index) )
+        {
+            glm::vec3 offset = chunk->get_centre() - eye;
+            queue.emplace_back(!is_visible(viewProjection, chunk->get_bounds()), glm::dot(offset, offset), index);
+        }
+    }
+    std::sort(queue.begin(), queue.end(), [](const auto& left, const auto& right)
+        {
+            return std::tie(std::get<0>(left), std::get<1>(left)) < std::tie(std::get<0>(right), std::get<1>(right));
+        });
+
+    m_dirtyChunks.clear();
+
+    // Background remeshes are limited so a large edit cannot queue more work than the workers get through
+    // in a few frames.
+    size_t maxRemeshing = std::max<size_t>(JobDispatch::get_worker_count(), 1) * 2;
+
+    bool submitted{ false };
+    auto canSubmit = [&]()
+        {
+            double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count();
+            bool overBudget = submitted && elapsedMs >= m_remeshBudgetMs;
+            bool saturated = g_useMultithreading && m_remeshingChunks.size() >= maxRemeshing;
+            return !overBudget && !saturated;
+        };
+
+    for( const auto& [hidden, distance, index] : queue )
+    {
+        // Chunks which cannot be submitted this frame stay dirty, their edits are picked up by a later remesh.
+        if( !canSubmit() || !get_chunk(index)->remesh() )
+        {
+            m_dirtyChunks.insert(index);
+            continue;
+        }
+
+        m_remeshingChunks.insert(index);
+        submitted = true;
+    }
+
+    // Idle chunks are simplified with whatever is left once every dirty chunk was submitted.
+    if( m_simplifyError <= 0.f || !m_dirtyChunks.empty() )
+    {
+        return;
+    }
+
+    for( auto& [index, chunk] : m_chunks )
+    {
+        if( !canSubmit() )
+        {
+            break;
+        }
+
+        if( !m_remeshingChunks.contains(index) && chunk->simplify(m_simplifyError, m_simplifyIdleSeconds) )
+        {
+            m_remeshingChunks.insert(index);
+            submitted = true;
+        }
+    }
+}
+
+void ChunkGrid::update_detail(glm::vec3 eye)
+{
+    if( m_lodDistance <= 0.f )
+    {
+        return;
+    }
+
+    std::unordered_map<glm::ivec3, uint32_t> levels;
+    levels.reserve(m_chunks.size());
+    for( auto& [index, chunk] : m_chunks )
+    {
+        float distance = glm::distance(chunk->get_centre(), eye);
+        uint32_t current = chunk->get_lod();
+        uint32_t coarser = get_lod(distance / (1.f + s_lodHysteresis));
+        uint32_t finer = get_lod(distance * (1.f + s_lodHysteresis));
+
+        levels.insert(std::pair(index, coarser > current ? coarser : std::min(finer, current)));
+    }
+
+    for( auto& [index, chunk] : m_chunks )
+    {
+        uint32_t level = levels.at(index);
+
+        mcube::SkirtFaces skirtFaces{ 0 };
+        for( uint32_t axis = 0; axis < 3; axis++ )
+        {
+            for( int side : { -1, 1 } )
+            {
+                glm::ivec3 neighbour = index;
+                neighbour[axis] += side;
+
+                auto it = levels.find(neighbour);
+                if( it != levels.end() && it->second != level )
+                {
+                    skirtFaces |= mcube::get_skirt_face(axis, side > 0);
+                }
+            }
+        }
+
+        if( chunk->set_detail(level, skirtFaces) )
+        {
+            m_dirtyChunks.insert(index);
+        }
+    }
+}
+
+uint32_t ChunkGrid::get_lod(float distance) const
+{
+    uint32_t retval{ 0 };
+    while( retval < s_maxLod && distance >= m_lodDistance * static_cast<float>(1u << retval) )
+    {
+        retval++;
+    }
+    return retval;
+}
+
+mcube::SampleRegion ChunkGrid::get_owned_region(glm::ivec3 index, uint32_t resolution) const
+{
+    // A chunk above along an axis always outranks this one for the apron samples along it.
+    mcube::SampleRegion retval{ glm::uvec3(0u), glm::uvec3(resolution - 1) };
+    for( uint32_t axis = 0; axis < 3; axis++ )
+    {
+        glm::ivec3 neighbour = index;
+        neighbour[axis]++;
+        if( get_chunk(neighbour) )
+        {
+            retval.max[axis] = resolution - 2;
+        }
+    }
+    return retval;
+}
+
+std::optional<glm::ivec3> ChunkGrid::get_owner(glm::ivec3 index, glm::ivec3 side, std::optional<glm::ivec3> excluded) const
+{
+    // Every chunk holding the samples sees the same lowest chunk and the same axes, so they all agree.
+    glm::ivec3 shared = glm::ivec3(glm::notEqual(side, glm::ivec3(0)));
+    glm::ivec3 lowest = index - glm::ivec3(glm::lessThan(side, glm::ivec3(0)));
+
+    for( glm::ivec3 offset : s_upperNeighbours )
+    {
+        if( (offset & shared) != offset || lowest + offset == excluded )
+        {
+            continue;
+        }
+
+        if( get_chunk(lowest + offset) )
+        {
+            return lowest + offset;
+        }
+    }
+
+    if( lowest != excluded && get_chunk(lowest) )
+    {
+        return lowest;
+    }
+    return std::nullopt;
+}
+
+void ChunkGrid::sync_apron(glm::ivec3 index)
+{
+    for_each_side([&](glm::ivec3 side)
+        {
+            std::optional<glm::ivec3> owner = get_owner(index, side);
+            if( !owner || *owner == index )
+            {
+                return;
+            }
+
+            copy_side(*owner, index, side);
+        });
+}
+
+void ChunkGrid::copy_side(glm::ivec3 source, glm::ivec3 destination, glm::ivec3 side)
+{
+    const ChunkVolume& sourceVolume = *get_chunk(source)->volume();
+    ChunkVolume& destinationVolume = *get_chunk(destination)->volume();
+    TRAP_NEQ(sourceVolume.get_dimensions(), destinationVolume.get_dimensions(), "Neighbouring chunks must have the same resolution.");
+
+    // The source is one chunk over along some of the side's axes, where its copy is on the opposite layer.
+    uint32_t resolution = destinationVolume.get_dimensions().x;
+    glm::ivec3 offset = source - destination;
+    copy_samples(sourceVolume, get_side_region(resolution, side - offset * 2), destinationVolume,
+                 get_side_region(resolution, side).min);
+}
+
+void ChunkGrid::seed_from_neighbours(glm::ivec3 index)
+{
+    for_each_side([&](glm::ivec3 side)
+        {
+            if( get_owner(index, side) != index )
+            {
+                return;
+            }
+
+            // Whoever owned the samples before this chunk existed holds their latest values.
+            if( std::optional<glm::ivec3> previous = get_owner(index, side, index) )
+            {
+                copy_side(*previous, index, side);
+            }
+        });
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+#include "Chunk.h"
+#include "scene/gameplay/Camera.h"
+
+#include <optional>
+
+// Regular grid of chunks where neighbouring volumes overlap by one sample. The last sample layer on each upper
+// face of a chunk is an apron ghosting the first layer of the chunks above, so a chunk meshes the cubes up to
+// its neighbours from its own volume and the seam is built from exactly the same samples on both sides.
+// Every shared sample has a single owner, see get_owner, and the other chunks holding it are refreshed from the
+// owner by copying after each edit, so all copies of a sample agree. A chunk owns its apron where there is no
+// neighbour above.
+class ChunkGrid
+{
+public:
+    ChunkGrid(Scene* scene, glm::vec3 chunkSize);
+    ChunkGrid(ChunkGrid&&) = delete;
+    ChunkGrid(const ChunkGrid&) = delete;
+    ChunkGrid& operator=(ChunkGrid&&) = delete;
+    ChunkGrid& operator=(const ChunkGrid&) = delete;
+
+    ~ChunkGrid();
+
+    // Creates the chunk at index, empty or holding volume if given. Samples written into the aprons of its
+    // neighbours while the chunk did not exist are newer than volume and are kept.
+    Chunk* create_chunk(glm::ivec3 index, std::unique_ptr<ChunkVolume> volume = nullptr);
+    // Destroys the chunk at index and returns its samples, the chunks around it take ownership of the samples
+    // they held copies of.
+    std::unique_ptr<ChunkVolume> destroy_chunk(glm::ivec3 index);
+    Chunk* get_chunk(glm::ivec3 index) const;
+
+    template<typename Fn>
+    void for_each_chunk(Fn&& fn) const
+    {
+        for( auto& [index, chunk] : m_chunks )
+        {
+            fn(index, *chunk);
+        }
+    }
+
+    size_t get_chunk_count() const;
+    glm::vec3 get_chunk_size() const;
+
+    // Index of the chunk containing a world space position.
+    glm::ivec3 get_chunk_index(glm::vec3 position) const;
+
+    // Calls fn(index, chunk) for every existing chunk overlapping world space bounds. The chunk indices are
+    // computed from the bounds so the cost follows the size of the bounds, not the number of chunks loaded.
+    // Usable as the broadphase of edits and, given a frustum's bounds, culling.
+    template<typename Fn>
+    void for_each_chunk_in_bounds(const AABoundingBox<float>& bounds, Fn&& fn) const
+    {
+        // A chunk whose upper face touches bounds.min still overlaps it through its apron.
+        glm::ivec3 first = glm::ivec3(glm::ceil(bounds.min / m_chunkSize)) - 1;
+        glm::ivec3 last = glm::ivec3(glm::floor(bounds.max / m_chunkSize));
+        glm::ivec3 range = glm::max(last - first + 1, 0);
+
+        if( static_cast<size_t>(range.x) * range.y * range.z > m_chunks.size() )
+        {
+            // Bounds cover more indices than there are chunks, test the chunks instead.
+            for( auto& [index, chunk] : m_chunks )
+            {
+                if( glm::all(glm::greaterThanEqual(index, first)) && glm::all(glm::lessThanEqual(index, last)) )
+                {
+                    fn(index, *chunk);
+                }
+            }
+            return;
+        }
+
+        for( int z = first.z; z <= last.z; z++ )
+        {
+            for( int y = first.y; y <= last.y; y++ )
+            {
+                for( int x = first.x; x <= last.x; x++ )
+                {
+                    if( Chunk* chunk = get_chunk({ x, y, z }) )
+                    {
+                        fn(glm::ivec3{ x, y, z }, *chunk);
+                    }
+                }
+            }
+        }
+    }
+
+    // Applies world space brushes to the chunks they overlap and refreshes the aprons ghosting the edit.
+    void apply_brushes(const std::vector<mcube::Brush>& brushes);
+
+    // Publishes finished remeshes and submits remeshes of the chunks modified since the last update. With
+    // multithreading the remeshes run in the background and chunks keep their current mesh meanwhile.
+    // Dirty chunks are submitted visible first and nearest to the camera first until the frame's remesh
+    // budget is spent, the rest wait for the next update. A chunk dirtied again before its remesh is
+    // submitted is still remeshed once. Chunks further from the camera than lod_distance are meshed at a
+    // lower level of detail, see update_detail. Once nothing is dirty, chunks left alone for
+    // chunk_simplify_idle_seconds are simplified with the rest of the budget, see Chunk::simplify.
+    void update(const Camera& camera);
+private:
+    // Bounds of the samples get_owner assigns to the chunk at index, the limit of its edits. Samples on an apron
+    // line within it can belong to a chunk on the diagonal, sync_apron overwrites those after an edit.
+    mcube::SampleRegion get_owned_region(glm::ivec3 index, uint32_t resolution) const;
+
+    // Index of the chunk which owns the samples on side of the chunk at index, see get_side_region. Candidates
+    // are every chunk holding the samples, counted from the lowest of them, and the one offset along the most
+    // axes wins. Every holder resolves the same owner, excluded is skipped to find the owner without a chunk.
+    std::optional<glm::ivec3> get_owner(glm::ivec3 index, glm::ivec3 side, std::optional<glm::ivec3> excluded = std::nullopt) const;
+
+    // Copies every shared sample of the chunk at index which another chunk owns from that chunk.
+    void sync_apron(glm::ivec3 index);
+
+    // Copies the samples the new chunk at index now owns from the chunk which owned them before.
+    void seed_from_neighbours(glm::ivec3 index);
+
+    // Copies the samples on side of destination from the copy held by source.
+    void copy_side(glm::ivec3 source, glm::ivec3 destination, glm::ivec3 side);
+
+    // Calls fn(index) for the chunk at index and every existing chunk it shares samples with.
+    template<typename Fn>
+    void for_each_neighbour(glm::ivec3 index, Fn&& fn) const
+    {
+        for( int z = -1; z <= 1; z++ )
+        {
+            for( int y = -1; y <= 1; y++ )
+            {
+                for( int x = -1; x <= 1; x++ )
+                {
+                    glm::ivec3 neighbour = index + glm::ivec3{ x, y, z };
+                    if( get_chunk(neighbour) )
+                    {
+                        fn(neighbour);
+                    }
+                }
+            }
+        }
+    }
+
+    // Picks every chunk's level of detail from its distance to eye, halving the detail each time the distance
+    // doubles past lod_distance. A chunk only changes level once it is s_lodHysteresis past the threshold so
+    // chunks on a threshold do not remesh back and forth. Faces towards a neighbour at another level get
+    // skirts, chunks whose level or skirts changed are marked dirty.
+    void update_detail(glm::vec3 eye);
+    uint32_t get_lod(float distance) const;
+private:
+    static constexpr uint32_t s_maxLod = 3;
+    static constexpr float s_lodHysteresis = 0.1f;
+
+    Scene* m_scene;
+    glm::vec3 m_chunkSize;
+    double m_remeshBudgetMs;
+    float m_lodDistance;
+    float m_simplifyError;
+    double m_simplifyIdleSeconds;
+
+    std::unordered_map<glm::ivec3, std::unique_ptr<Chunk>> m_chunks;
+    std::unordered_set<glm::ivec3> m_dirtyChunks;
+    std::unordered_set<glm::ivec3> m_remeshingChunks;
+};
@@ -0,0 +1,367 @@
+#include "ChunkStreamer.h"
+
+#include "device/fiDevice.h"
+#include "threading/JobDispatcher.h"
+
+#include <filesystem>
+
+#define DEFAULT_CHUNK_LOAD_RADIUS 25.f
+#define DEFAULT_CHUNK_UNLOAD_RADIUS 40.f
+PARAM(chunk_load_radius);
+PARAM(chunk_unload_radius);
+
+ChunkStreamer::ChunkStreamer(ChunkGrid* grid, std::string directory) :
+    ChunkStreamer(grid, std::move(directory), true)
+{ }
+
+ChunkStreamer::ChunkStreamer(ChunkGrid* grid) :
+    ChunkStreamer(grid, { }, false)
+{ }
+
+ChunkStreamer::ChunkStreamer(ChunkGrid* grid, std::string directory, bool persistent) :
+    m_grid(grid),
+    m_directory(std::move(directory)),
+    m_persistent(persistent),
+    m_paging(true),
+    m_loadRadius(DEFAULT_CHUNK_LOAD_RADIUS),
+    m_unloadRadius(DEFAULT_CHUNK_UNLOAD_RADIUS)
+{
+    Param_chunk_load_radius.get_float(&m_loadRadius);
+    Param_chunk_unload_radius.get_float(&m_unloadRadius);
+
+    // A chunk unloaded at the unload radius must be further than a chunk's width from the load radius, or
+    // moving back across its own width would page it straight back in.
+    glm::vec3 chunkSize = m_grid->get_chunk_size();
+    m_unloadRadius = std::max(m_unloadRadius, m_loadRadius + std::max({ chunkSize.x, chunkSize.y, chunkSize.z }));
+
+    jclog::Log& log = *g_singleThreadedLog;
+    std::error_code error;
+    if( m_persistent )
+    {
+        std::filesystem::create_directories(m_directory, error);
+        if( !error )
+        {
+            return;
+        }
+        JCLOG_ERROR(log, "Chunk directory '{}' could not be created ({}), paging to a scratch directory instead.", m_directory, error.message());
+        m_persistent = false;
+    }
+
+    std::filesystem::path temp = std::filesystem::temp_directory_path(error);
+    if( error )
+    {
+        JCLOG_ERROR(log, "No temporary directory to page chunks to ({}), chunks stay in memory.", error.message());
+        m_paging = false;
+        return;
+    }
+
+    // Never anything which existed before, a name already taken belongs to another run.
+    std::filesystem::path scratch;
+    uint64_t stamp = static_cast<uint64_t>(std::chrono::system_clock::now().time_since_epoch().count());
+    bool created;
+    do
+    {
+        scratch = temp / std::format("mcube_chunks_{}", stamp++);
+        created = std::filesystem::create_directory(scratch, error);
+    } while( !created && !error );
+
+    if( error )
+    {
+        JCLOG_ERROR(log, "Scratch directory '{}' could not be created ({}), chunks stay in memory.", scratch.string(), error.message());
+        m_paging = false;
+        return;
+    }
+    m_directory = scratch.string();
+}
+
+ChunkStreamer::~ChunkStreamer()
+{
+    // Workers hold references to the tasks' volumes until they finish.
+    auto isRunning = [](const auto& pair) { return !pair.second->job.is_done(); };
+    while( std::any_of(m_loads.begin(), m_loads.end(), isRunning) || std::any_of(m_saves.begin(), m_saves.end(), isRunning) )
+    {
+        JobDispatch::poll();
+    }
+
+    if( !m_paging )
+    {
+        return;
+    }
+
+    // A failed write gets one last try, the scratch directory is about to be removed so it only matters there
+    // when the directory is kept.
+    jclog::Log& log = *g_singleThreadedLog;
+    for( const auto& [index, task] : m_saves )
+    {
+        if( !task->saved && !(m_persistent && save_volume(*task->volume, get_chunk_path(index))) )
+        {
+            JCLOG_ERROR(log, "Chunk could not be written to '{}', its edits are lost.", get_chunk_path(index));
+        }
+    }
+
+    if( m_persistent )
+    {
+        m_grid->for_each_chunk([this, &log](glm::ivec3 index, Chunk& chunk)
+            {
+                if( !save_volume(*chunk.volume(), get_chunk_path(index)) )
+                {
+                    JCLOG_ERROR(log, "Chunk could not be written to '{}', its edits are lost.", get_chunk_path(index));
+                }
+            });
+        return;
+    }
+
+    std::error_code error;
+    for( glm::ivec3 index : m_written )
+    {
+        std::filesystem::remove(get_chunk_path(index), error);
+    }
+    // Only succeeds once empty, anything else placed there is left alone.
+    std::filesystem::remove(m_directory, error);
+}
+
+void ChunkStreamer::update(glm::vec3 centre)
+{
+    finish_saves();
+    finish_loads(centre);
+    request_loads(centre);
+    request_unloads(centre);
+}
+
+float ChunkStreamer::get_load_radius() const
+{
+    return m_loadRadius;
+}
+
+float ChunkStreamer::get_unload_radius() const
+{
+    return m_unloadRadius;
+}
+
+size_t ChunkStreamer::get_pending_count() const
+{
+    return m_loads.size() + m_saves.size();
+}
+
+void ChunkStreamer::finish_saves()
+{
+    auto now = std::chrono::steady_clock::now();
+    for( auto it = m_saves.begin(); it != m_saves.end(); )
+    {
+        SaveTask& task = *it->second;
+        if( !task.job.is_done() )
+        {
+            ++it;
+            continue;
+        }
+
+        // A chunk paged back in while its write ran holds newer samples than the task, they are written once it is
+        // unloaded again.
+        if( task.saved || m_grid->get_chunk(it->first) )
+        {
+            it = m_saves.erase(it);
+            continue;
+        }
+
+        // The volume stays in memory until a write goes through, so a full disk or a lost permission only
+        // holds on to the chunk rather than dropping its edits.
+        if( !task.retryTime )
+        {
+            jclog::Log& log = *g_singleThreadedLog;
+            JCLOG_ERROR(log, "Chunk could not be written to '{}', retrying in {}s.", get_chunk_path(it->first), s_saveRetryDelay.count());
+            task.retryTime = now + s_saveRetryDelay;
+        }
+        else if( now >= *task.retryTime )
+        {
+            task.retryTime.reset();
+            submit_save(it->first, it->second);
+        }
+        ++it;
+    }
+}
+
+void ChunkStreamer::finish_loads(glm::vec3 centre)
+{
+    for( auto it = m_loads.begin(); it != m_loads.end(); )
+    {
+        LoadTask& task = *it->second;
+        if( !task.job.is_done() )
+        {
+            ++it;
+            continue;
+        }
+
+        if( task.corrupt )
+        {
+            jclog::Log& log = *g_singleThreadedLog;
+            JCLOG_WARN(log, "Chunk data at '{}' is corrupt, creating an empty chunk instead.", get_chunk_path(it->first));
+        }
+
+        // The camera may have moved away while the chunk was read, the saved data is still on disk.
+        if( get_distance(centre, it->first) <= m_unloadRadius )
+        {
+            m_grid->create_chunk(it->first, std::move(task.volume));
+        }
+        it = m_loads.erase(it);
+    }
+}
+
+void ChunkStreamer::request_loads(glm::vec3 centre)
+{
+    size_t maxLoads = std::max<size_t>(JobDispatch::get_worker_count(), 1) * s_loadsPerWorker;
+    if( m_loads.size() >= maxLoads )
+    {
+        return;
+    }
+
+    glm::ivec3 first = m_grid->get_chunk_index(centre - m_loadRadius);
+    glm::ivec3 last = m_grid->get_chunk_index(centre + m_loadRadius);
+
+    std::vector<std::pair<float, glm::ivec3>> missing;
+    for( int z = first.z; z <= last.z; z++ )
+    {
+        for( int y = first.y; y <= last.y; y++ )
+        {
+            for( int x = first.x; x <= last.x; x++ )
+            {
+                glm::ivec3 index{ x, y, z };
+                float distance = get_distance(centre, index);
+                if( distance <= m_loadRadius && !m_grid->get_chunk(index) && !m_loads.contains(index) )
+                {
+                    missing.emplace_back(distance, index);
+                }
+            }
+        }
+    }
+    std::sort(missing.begin(), missing.end(), [](const auto& left, const auto& right)
+        {
+            return left.first < right.first;
+        });
+
+    for( const auto& [distance, index] : missing )
+    {
+        // Nothing is ever unloaded without a directory, a missing chunk has never existed.
+        if( !m_paging )
+        {
+            m_grid->create_chunk(index);
+            continue;
+        }
+
+        // A chunk still being written is paged back in from the copy in memory. A failed write waiting for
+        // its retry is dropped, the chunk is live again and is saved anew once it is unloaded.
+        auto save = m_saves.find(index);
+        if( save != m_saves.end() )
+        {
+            m_grid->create_chunk(index, std::make_unique<ChunkVolume>(*save->second->volume));
+            if( save->second->job.is_done() )
+            {
+                m_saves.erase(save);
+            }
+            continue;
+        }
+
+        if( m_loads.size() >= maxLoads )
+        {
+            break;
+        }
+
+        auto task = std::make_shared<LoadTask>();
+        m_loads.insert(std::pair(index, task));
+
+        if( g_useMultithreading )
+        {
+            task->job = JobDispatch::execute_background([task, path = get_chunk_path(index)]()
+                {
+                    load_volume(*task, path);
+                });
+        }
+        else
+        {
+            load_volume(*task, get_chunk_path(index));
+        }
+    }
+}
+
+void ChunkStreamer::request_unloads(glm::vec3 centre)
+{
+    if( !m_paging )
+    {
+        return;
+    }
+
+    std::vector<glm::ivec3> distant;
+    m_grid->for_each_chunk([&](glm::ivec3 index, Chunk&)
+        {
+            // Waiting for the previous write keeps two writes to the same file from racing.
+            if( get_distance(centre, index) > m_unloadRadius && !m_saves.contains(index) )
+            {
+                distant.push_back(index);
+            }
+        });
+
+    for( glm::ivec3 index : distant )
+    {
+        auto task = std::make_shared<SaveTask>();
+        task->volume = m_grid->destroy_chunk(index);
+        m_saves.insert(std::pair(index, task));
+        m_written.insert(index);
+        submit_save(index, task);
+    }
+}
+
+void ChunkStreamer::submit_save(glm::ivec3 index, const std::shared_ptr<SaveTask>& task)
+{
+    if( g_useMultithreading )
+    {
+        task->job = JobDispatch::execute_background([task, path = get_chunk_path(index)]()
+            {
+                task->saved = save_volume(*task->volume, path);
+            });
+    }
+    else
+    {
+        task->saved = save_volume(*task->volume, get_chunk_path(index));
+    }
+}
+
+float ChunkStreamer::get_distance(glm::vec3 point, glm::ivec3 index) const
+{
+    glm::vec3 min = glm::vec3(index) * m_grid->get_chunk_size();
+    glm::vec3 max = min + m_grid->get_chunk_size();
+    return glm::distance(point, glm::clamp(point, min, max));
+}
+
+std::string ChunkStreamer::get_chunk_path(glm::ivec3 index) const
+{
+    return std::format("{}/chunk_{}_{}_{}.bin", m_directory, index.x, index.y, index.z);
+}
+
+bool ChunkStreamer::save_volume(const ChunkVolume& volume, const std::string& path)
+{
+    std::vector<uint8_t> data;
+    volume.serialize(data);
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(data.data()), data.size());
+
+    // Closing flushes, a write which only fails then still sets failbit.
+    file.close();
+    return !file.fail();
+}
+
+void ChunkStreamer::load_volume(LoadTask& task, const std::string& path)
+{
+    fiDevice device;
+    if( device.open(path.c_str()) )
+    {
+        std::vector<uint8_t> data = device.read(device.get_size());
+
+        uint32_t resolution = Chunk::get_resolution();
+        task.volume = std::make_unique<ChunkVolume>(glm::uvec3(resolution));
+        if( !task.volume->deserialize(data.data(), data.size()) )
+        {
+            task.volume = nullptr;
+            task.corrupt = true;
+        }
+    }
+}
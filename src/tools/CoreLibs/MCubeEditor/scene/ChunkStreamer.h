@@ -0,0 +1,90 @@
+#pragma once
+
+#include "ChunkGrid.h"
+
+// Pages the chunks of a ChunkGrid in and out around a point so only the neighbourhood of the camera is held
+// in memory. Missing chunks within the load radius are created, their samples read back on a worker if they
+// were saved before. Chunks beyond the unload radius are removed from the grid and written out on a worker.
+// The gap between the two radii stops chunks on the boundary from being paged every frame.
+class ChunkStreamer
+{
+public:
+    // Chunks are read from and written to directory, which is kept between runs and receives every loaded
+    // chunk when the streamer is destroyed. Falls back to a scratch directory if directory cannot be created.
+    ChunkStreamer(ChunkGrid* grid, std::string directory);
+
+    // Chunks are paged out to a scratch directory of this run under the system's temporary directory. The
+    // files written to it and the directory itself are removed when the streamer is destroyed. Without a
+    // temporary directory nothing is paged out and chunks are only created around the point.
+    explicit ChunkStreamer(ChunkGrid* grid);
+    ChunkStreamer(ChunkStreamer&&) = delete;
+    ChunkStreamer(const ChunkStreamer&) = delete;
+    ChunkStreamer& operator=(ChunkStreamer&&) = delete;
+    ChunkStreamer& operator=(const ChunkStreamer&) = delete;
+
+    ~ChunkStreamer();
+
+    // Creates the chunks which finished loading and requests the loads and unloads around centre.
+    void update(glm::vec3 centre);
+
+    float get_load_radius() const;
+    float get_unload_radius() const;
+
+    // Loads and saves still running on workers or waiting to retry.
+    size_t get_pending_count() const;
+private:
+    struct LoadTask
+    {
+        // Null if the chunk has never been saved or its data could not be read.
+        std::unique_ptr<ChunkVolume> volume;
+        bool corrupt{ false };
+        // Done once the results above are written, empty when the task ran on the submitting thread.
+        JobHandle job;
+    };
+
+    struct SaveTask
+    {
+        std::unique_ptr<ChunkVolume> volume;
+        // Whether the last write went through, the task and its volume are only dropped once one has.
+        bool saved{ false };
+        // When a failed write is tried again, set once the failure has been reported.
+        std::optional<std::chrono::steady_clock::time_point> retryTime;
+        // Done once the volume is written out, empty when the task ran on the submitting thread.
+        JobHandle job;
+    };
+
+    ChunkStreamer(ChunkGrid* grid, std::string directory, bool persistent);
+
+    void finish_saves();
+    void finish_loads(glm::vec3 centre);
+    void request_loads(glm::vec3 centre);
+    void request_unloads(glm::vec3 centre);
+    void submit_save(glm::ivec3 index, const std::shared_ptr<SaveTask>& task);
+
+    // Distance from point to the nearest point of the chunk at index.
+    float get_distance(glm::vec3 point, glm::ivec3 index) const;
+    std::string get_chunk_path(glm::ivec3 index) const;
+
+    // False if the file could not be written, the file may be left truncated.
+    static bool save_volume(const ChunkVolume& volume, const std::string& path);
+    static void load_volume(LoadTask& task, const std::string& path);
+private:
+    static constexpr size_t s_loadsPerWorker = 4;
+    static constexpr std::chrono::seconds s_saveRetryDelay{ 5 };
+
+    ChunkGrid* m_grid;
+    std::string m_directory;
+    bool m_persistent;
+    // Off when no directory could be created, every chunk is then kept in memory.
+    bool m_paging;
+
+    float m_loadRadius;
+    float m_unloadRadius;
+
+    std::unordered_map<glm::ivec3, std::shared_ptr<LoadTask>> m_loads;
+    // Chunks being written or waiting to retry a failed write, they are paged back in from memory rather than
+    // racing the write or reading what it left behind.
+    std::unordered_map<glm::ivec3, std::shared_ptr<SaveTask>> m_saves;
+    // Every chunk written to a scratch directory, the only files removed with it.
+    std::unordered_set<glm::ivec3> m_written;
+};
@@ -189,6 +189,16 @@ public:
         return m_data[index];
     }
 
+    constexpr T* data()
+    {
+        return m_data;
+    }
+
+    constexpr const T* data() const
+    {
+        return m_data;
+    }
+
     constexpr size_t size() const
     {
         return m_size;
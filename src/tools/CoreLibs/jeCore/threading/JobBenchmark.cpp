@@ -0,0 +1,148 @@
+#include "JobBenchmark.h"
+
+#include "JobScheduler.h"
+#include "Queue.h"
+#include "threading.h"
+
+// The single queue JobDispatch ran on before JobScheduler, kept as the baseline. Every submit and every pop
+// takes the same lock and producers spin while the ring buffer is full.
+class MutexQueuePool
+{
+public:
+    explicit MutexQueuePool(uint32_t workerCount)
+    {
+        for( uint32_t i = 0; i < workerCount; i++ )
+        {
+            m_workers.push_back(request_thread(std::format("QUEUE_WORKER_{}", i), [this]{
+                    std::function<void()> activeJob;
+                    while( true )
+                    {
+                        if( m_jobPool.pop_front(&activeJob) )
+                        {
+                            activeJob();
+                            continue;
+                        }
+
+                        std::unique_lock<std::mutex> lock(m_wakeMutex);
+                        if( m_stopping )
+                        {
+                            break;
+                        }
+                        m_wakeCondition.wait(lock);
+                    }
+            }));
+        }
+    }
+
+    ~MutexQueuePool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_wakeMutex);
+            m_stopping = true;
+        }
+        m_wakeCondition.notify_all();
+
+        for( std::thread& worker : m_workers )
+        {
+            worker.join();
+        }
+    }
+
+    inline void submit(const std::function<void()>& job)
+    {
+        while( !m_jobPool.push_back(job) )
+        {
+            poll();
+        }
+        m_wakeCondition.notify_one();
+    }
+
+    inline void poll()
+    {
+        m_wakeCondition.notify_one();
+        std::this_thread::yield();
+    }
+private:
+    threadsafe::Queue<std::function<void()>, 256> m_jobPool{ };
+    std::vector<std::thread> m_workers;
+    std::mutex m_wakeMutex;
+    std::condition_variable m_wakeCondition;
+    // Guarded by m_wakeMutex.
+    bool m_stopping{ false };
+};
+
+static void spend_work(uint32_t iterations)
+{
+    // Enough dependent arithmetic for the compiler not to drop it.
+    uint32_t state = 0x9e3779b9u;
+    for( uint32_t i = 0; i < iterations; i++ )
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+    }
+
+    static std::atomic<uint32_t> sink{ 0 };
+    sink.fetch_xor(state == 0 ? 1u : 0u, std::memory_order_relaxed);
+}
+
+template<typename Pool>
+static double measure_jobs_per_second(uint32_t workerCount, uint32_t jobCount, uint32_t workIterations)
+{
+    Pool pool(workerCount);
+    std::atomic<uint32_t> remaining{ jobCount };
+
+    auto begin = std::chrono::high_resolution_clock::now();
+    for( uint32_t i = 0; i < jobCount; i++ )
+    {
+        pool.submit([&remaining, workIterations]{
+                spend_work(workIterations);
+                remaining.fetch_sub(1);
+        });
+    }
+
+    while( remaining.load() != 0 )
+    {
+        pool.poll();
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    return jobCount / std::chrono::duration<double>(end - begin).count();
+}
+
+// Adapts JobScheduler to the interface the benchmark expects of a pool.
+class SchedulerPool : public JobScheduler
+{
+public:
+    explicit SchedulerPool(uint32_t workerCount) :
+        JobScheduler(workerCount, "BENCHMARK_WORKER")
+    { }
+
+    inline void poll()
+    {
+        std::this_thread::yield();
+    }
+};
+
+void run_job_benchmark(const std::vector<uint32_t>& workerCounts, uint32_t jobCount)
+{
+    constexpr std::pair<const char*, uint32_t> workloads[]{
+        { "empty", 0 },
+        { "1us", 400 },
+    };
+
+    jclog::Log& log = *g_singleThreadedLog;
+    JCLOG_INFO(log, "Job benchmark, {} jobs submitted from one thread", jobCount);
+
+    for( uint32_t workerCount : workerCounts )
+    {
+        for( const auto& [workloadName, workIterations] : workloads )
+        {
+            double queue = measure_jobs_per_second<MutexQueuePool>(workerCount, jobCount, workIterations);
+            double stealing = measure_jobs_per_second<SchedulerPool>(workerCount, jobCount, workIterations);
+
+            JCLOG_INFO(log, "{:>2} workers {:<6} mutex queue {:>12.0f} jobs/s work stealing {:>12.0f} jobs/s ({:.2f}x, {:.0f}ns per job)",
+                workerCount, workloadName, queue, stealing, stealing / queue, 1e9 / stealing);
+        }
+    }
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <vector>
+
+// Submits jobCount jobs from one thread to pools of each worker count and logs the jobs completed per second,
+// once through JobScheduler and once through the mutex guarded ring buffer JobDispatch used before it. Jobs are
+// either empty, measuring the scheduling overhead alone, or spend about a microsecond of work.
+void run_job_benchmark(const std::vector<uint32_t>& workerCounts, uint32_t jobCount);
@@ -1,9 +1,15 @@
 #include "JobDispatcher.h"
 
 #include <thread>
+#include <utility>
 
 JobDispatch* JobDispatch::m_instance = nullptr;
 
+// Waits running inside a job which was itself run by a waiting thread. Every level keeps the frames of the jobs
+// below it on the stack, past s_maxHelpDepth a wait only yields until the others catch up.
+static thread_local uint32_t s_helpDepth{ 0 };
+static constexpr uint32_t s_maxHelpDepth = 16;
+
 
 #define DEFAULT_WORKER_THREADS 4
 PARAM(worker_threads);
@@ -30,168 +36,132 @@ void JobDispatch::initialize()
         workers = std::max(1u, workers);
     }
 
-    // thread data
-    threadsafe::Queue<std::function<void()>, 256>& pool = instance().m_jobPool;
-    std::mutex& wakeMutex = instance().m_wakeMutex;
-    std::condition_variable& wakeCondition = instance().m_wakeCondition;
-
-    instance().m_workers.resize(workers);
+    instance().m_scheduler = std::make_unique<JobScheduler>(workers, "WORKER");
     for( uint32_t i = 0; i < workers; i++ )
     {
-        // data
-        WorkerInfo& info = instance().m_workers.at(i);
-        std::string workerName(std::format("WORKER_{}", i));
-
-        std::thread worker = request_thread(workerName, [&]{
-                std::function<void()> activeJob;
-                info.state = IDLE;
-
-                while( true )
-                {
-                    if( pool.pop_front(&activeJob) )
-                    {
-                        info.state = WORKING;
-                        activeJob();
-                    }
-                    else
-                    {
-                        info.state = IDLE;
-                        std::unique_lock<std::mutex> lock(wakeMutex);
-                        wakeCondition.wait(lock);
-                    }
-                }
-        });
-
-        info.id = worker.get_id();
+        std::thread::id id = instance().m_scheduler->get_worker_id(i);
         auto pair = instance().m_threadLogs.emplace(
             std::piecewise_construct,
-            std::tuple(info.id),
+            std::tuple(id),
             std::tuple());
 
-        std::string logFilename = std::format("logs/{}.txt", workerName.c_str());
+        std::string logFilename = std::format("logs/WORKER_{}.txt", i);
         std::remove(logFilename.c_str());
         pair.first->second.register_target(new jclog::FileTarget(logFilename.c_str()));
-
-        worker.detach();
     }
 }
 
 size_t JobDispatch::get_worker_count()
 {
-    return instance().m_workers.size();
+    return instance().m_scheduler->get_worker_count();
 }
 
 void JobDispatch::poll()
 {
-    instance().m_wakeCondition.notify_one();
-    std::this_thread::yield();
-}
-
-std::atomic<uint32_t>* JobDispatch::request_atomic_counter(uint32_t initialValue)
-{
-    auto result = instance().m_counters.emplace(new std::atomic<uint32_t>(initialValue));
-    return *(result.first);
-}
-
-void JobDispatch::reset_counters()
-{
-    for( std::atomic<uint32_t>* counter : instance().m_counters )
+    if( s_helpDepth >= s_maxHelpDepth )
     {
-        delete counter;
+        std::this_thread::yield();
+        return;
     }
 
-    instance().m_counters.clear();
-}
+    // A job run here can wait on work of its own and helps in turn one level further down. The interrupted wait
+    // only resumes once that job returns, so jobs must not wait on anything the waiting frame does afterwards and
+    // waits must not be made while holding a lock the jobs take. Background jobs are left to the workers, a wait
+    // only picks up normal jobs, the short pieces parallel work is split into.
+    s_helpDepth++;
+    bool ran = instance().m_scheduler->run_pending_job();
+    s_helpDepth--;
 
-jclog::Log& JobDispatch::get_thread_log(std::thread::id tid)
-{
-    return instance().m_threadLogs.at(tid);
+    if( !ran )
+    {
+        std::this_thread::yield();
+    }
 }
 
-JobDispatch& JobDispatch::instance()
+void JobDispatch::wait(const JobHandle& handle)
 {
-    return *m_instance;
+    while( !handle.is_done() )
+    {
+        poll();
+    }
 }
 
-std::atomic<uint32_t>* JobDispatch::execute(const std::function<void()>& job)
+void JobDispatch::submit_after(Job* job, std::span<const JobHandle> dependencies)
 {
-    std::atomic<uint32_t>* retval = request_atomic_counter(1u);
-
-    std::function<void()> trackedJob = [retval, &job]{
-        job();
-        (*retval)--;
-    };
+    if( dependencies.empty() )
+    {
+        instance().m_scheduler->submit(job);
+        return;
+    }
 
-    while( !instance().m_jobPool.push_back(trackedJob) )
+    JobCounter* gate = JobCounter::create(static_cast<uint32_t>(dependencies.size()) + 1u);
+    gate->gatedJob = job;
+    for( const JobHandle& dependency : dependencies )
     {
-        poll();
+        JobCounter* counter = dependency.m_counter;
+        bool waiting{ false };
+        if( counter )
+        {
+            std::lock_guard<std::mutex> lock(counter->waiterMutex);
+            if( !counter->finished )
+            {
+                counter->waiters.push_back(gate);
+                waiting = true;
+            }
+        }
+
+        // Already finished, its waiters have been taken.
+        if( !waiting )
+        {
+            complete(*gate, 1u);
+        }
     }
-    instance().m_wakeCondition.notify_one();
 
-    return retval;
+    // The gate can't open before every dependency has been looked at.
+    complete(*gate, 1u);
 }
 
-void JobDispatch::execute_and_wait(const std::function<void()>& job)
+void JobDispatch::complete(JobCounter& counter, uint32_t amount)
 {
-    std::atomic<uint32_t>* counter = execute(job);
-    while( counter->load() != 0u )
+    if( counter.value.fetch_sub(amount, std::memory_order_acq_rel) != amount )
     {
-        poll();
+        return;
     }
-    instance().m_wakeCondition.notify_one();
-    return;
-}
-
-std::atomic<uint32_t>* JobDispatch::dispatch(uint32_t jobCount, uint32_t groupSize, const std::function<void(DispatchState)>& job)
-{
-    std::atomic<uint32_t>* retval = request_atomic_counter(jobCount);
 
-    if( jobCount == 0 || groupSize == 0 )
     {
-        retval->store(0u);
-        return retval;
+        std::lock_guard<std::mutex> lock(counter.waiterMutex);
+        counter.finished = true;
     }
 
-    uint32_t groupCount = (jobCount + groupSize - 1) / groupSize;
-
-    for( uint32_t i = 0; i < groupCount; i++ )
+    if( Job* job = std::exchange(counter.gatedJob, nullptr) )
     {
-        std::function<void()> groupJob = [=, &job](){
-            DispatchState state{ };
-            state.groupIndex = i;
-
-            uint32_t groupStartIndex = groupSize * i;
-            uint32_t groupEndIndex = std::min(groupStartIndex + groupSize, jobCount);
-
-            for( uint32_t jobGroupIndex = 0; jobGroupIndex < groupEndIndex - groupStartIndex; jobGroupIndex++ )
-            {
-                state.jobGroupIndex = jobGroupIndex;
-                state.jobIndex = groupStartIndex + jobGroupIndex;
-
-                job(state);
-                (*retval)--;
-            }
+        instance().m_scheduler->submit(job);
+    }
 
-        };
+    // Nothing is added once finished is set. The graph has no cycles, so this never comes back to counter.
+    for( JobCounter* waiter : counter.waiters )
+    {
+        complete(*waiter, 1u);
+    }
+    counter.waiters.clear();
 
-        while( !instance().m_jobPool.push_back(groupJob) )
-        {
-            poll();
-        }
+    counter.release();
+}
 
-        instance().m_wakeCondition.notify_one();
-    }
+jclog::Log& JobDispatch::get_thread_log(std::thread::id tid)
+{
+    return instance().m_threadLogs.at(tid);
+}
 
-    return retval;
+JobDispatch& JobDispatch::instance()
+{
+    return *m_instance;
 }
 
-void JobDispatch::dispatch_and_wait(uint32_t jobCount, uint32_t groupSize, const std::function<void(DispatchState)>& job)
+void JobDispatch::wait(const std::atomic<uint32_t>& counter)
 {
-    std::atomic<uint32_t>* counter = dispatch(jobCount, groupSize, job);
-    while( counter->load() != 0u )
+    while( counter.load() != 0u )
     {
         poll();
     }
-    instance().m_wakeCondition.notify_one();
-    return;
-}
\ No newline at end of file
+}
@@ -2,7 +2,10 @@
 
 #include <functional>
 #include <atomic>
-#include "Queue.h"
+#include <ranges>
+#include <span>
+#include "JobHandle.h"
+#include "JobScheduler.h"
 #include "threading.h"
 
 struct DispatchState
@@ -12,17 +15,33 @@ struct DispatchState
     uint32_t jobGroupIndex;
 };
 
-enum WorkerState
+// Half open range of indices handed to the callbacks of JobDispatch::parallel_for.
+struct DispatchRange
 {
-    UNINITIALIZED = 0,
-    IDLE,
-    WORKING
+    uint32_t begin;
+    uint32_t end;
+
+    inline uint32_t size() const
+    {
+        return end - begin;
+    }
 };
 
-struct WorkerInfo
+// Half open box of locations handed to the callbacks of the 3D JobDispatch::parallel_for.
+struct DispatchRange3d
 {
-    std::thread::id id{ };
-    WorkerState state{ UNINITIALIZED };
+    glm::uvec3 begin{ 0u };
+    glm::uvec3 end{ 0u };
+
+    inline glm::uvec3 size() const
+    {
+        return glm::max(end, begin) - begin;
+    }
+
+    inline bool empty() const
+    {
+        return glm::any(glm::lessThanEqual(end, begin));
+    }
 };
 
 class JobDispatch
@@ -32,32 +51,341 @@ public:
 
     static size_t get_worker_count();
 
-    [[nodiscard]] 
-    static std::atomic<uint32_t>* execute(const std::function<void()>& job);
-    static void execute_and_wait(const std::function<void()>& job);
+    // Queues a copy of job once every dependency is done, the returned handle is done once it ran. Callables are
+    // stored in the job record itself, see Job, so a lambda with a few captures is submitted without allocating.
+    template<typename Fn>
+    [[nodiscard]]
+    static JobHandle execute(Fn&& job, std::span<const JobHandle> dependencies = { })
+    {
+        JobCounter* counter = JobCounter::create(1u);
+        JobHandle retval(counter);
+        submit_after(Job::create([counter, job = std::forward<Fn>(job)]() mutable {
+            job();
+            complete(*counter, 1u);
+        }), dependencies);
+        return retval;
+    }
+
+    template<typename Fn>
+    [[nodiscard]]
+    static JobHandle execute(Fn&& job, const JobHandle& dependency)
+    {
+        return execute(std::forward<Fn>(job), std::span<const JobHandle>(&dependency, 1));
+    }
+
+    // Queues a copy of job at JobPriority::BACKGROUND, for long work which a wait must never end up running
+    // such as remeshes and disk IO. The returned handle is done once it ran.
+    template<typename Fn>
+    [[nodiscard]]
+    static JobHandle execute_background(Fn&& job)
+    {
+        JobCounter* counter = JobCounter::create(1u);
+        JobHandle retval(counter);
+        instance().m_scheduler->submit(Job::create([counter, job = std::forward<Fn>(job)]() mutable {
+            job();
+            complete(*counter, 1u);
+        }), JobPriority::BACKGROUND);
+        return retval;
+    }
+
+    // Continuation of dependency, queues a copy of job once it is done.
+    template<typename Fn>
+    [[nodiscard]]
+    static JobHandle then(const JobHandle& dependency, Fn&& job)
+    {
+        return execute(std::forward<Fn>(job), dependency);
+    }
+
+    template<typename Fn>
+    static void execute_and_wait(Fn&& job)
+    {
+        // The caller's job outlives the wait, neither the job nor the counter need to be kept elsewhere.
+        std::atomic<uint32_t> counter{ 1u };
+        instance().m_scheduler->submit([&counter, &job]{
+            job();
+            counter.fetch_sub(1u);
+        });
+        wait(counter);
+    }
+
+    // Calls job(DispatchState) for every index below jobCount, groupSize indices per submitted job, once every
+    // dependency is done. job is referenced rather than copied and has to outlive the returned handle.
+    template<typename Fn>
+    [[nodiscard]]
+    static JobHandle dispatch(uint32_t jobCount, uint32_t groupSize, const Fn& job,
+                              std::span<const JobHandle> dependencies = { })
+    {
+        if( jobCount == 0 || groupSize == 0 )
+        {
+            return execute([]{ }, dependencies);
+        }
+
+        JobCounter* counter = JobCounter::create(jobCount);
+        JobHandle retval(counter);
+        if( dependencies.empty() )
+        {
+            submit_groups(*counter, jobCount, groupSize, job);
+        }
+        else
+        {
+            // The groups are only known to the scheduler once the dependencies are done, a single gated job
+            // queues all of them.
+            submit_after(Job::create([counter, jobCount, groupSize, &job]{
+                submit_groups(*counter, jobCount, groupSize, job);
+            }), dependencies);
+        }
+        return retval;
+    }
+
+    template<typename Fn>
+    [[nodiscard]]
+    static JobHandle dispatch(uint32_t jobCount, uint32_t groupSize, const Fn& job, const JobHandle& dependency)
+    {
+        return dispatch(jobCount, groupSize, job, std::span<const JobHandle>(&dependency, 1));
+    }
+
+    template<typename Fn>
+    static void dispatch_and_wait(uint32_t jobCount, uint32_t groupSize, const Fn& job)
+    {
+        std::atomic<uint32_t> counter{ jobCount };
+        submit_groups(counter, jobCount, groupSize, job);
+        wait(counter);
+    }
+
+    // Number of indices per sub-range which gives every worker and the waiting thread a few sub-ranges of count,
+    // enough for the stealing to even out uneven work without paying for a job per index.
+    static uint32_t get_grain_size(uint32_t count)
+    {
+        size_t chunkCount = (get_worker_count() + 1) * s_chunksPerThread;
+        return static_cast<uint32_t>(std::max<size_t>((count + chunkCount - 1) / chunkCount, 1));
+    }
+
+    // Sub-ranges span whole rows along x and are split over y and z, so callbacks always walk contiguous rows.
+    static glm::uvec3 get_grain_size(const DispatchRange3d& range)
+    {
+        glm::uvec3 size = range.size();
+        uint32_t rows = get_grain_size(size.y * size.z);
+        if( rows >= size.y )
+        {
+            return { size.x, size.y, rows / size.y };
+        }
+        return { size.x, rows, 1u };
+    }
+
+    // Calls fn(DispatchRange) for contiguous sub-ranges of up to grain indices covering [0, count) and waits for
+    // all of them. A grain of zero picks one with get_grain_size. A single sub-range runs on the calling thread.
+    template<typename Fn>
+    static void parallel_for(uint32_t count, uint32_t grain, const Fn& fn)
+    {
+        grain = grain ? grain : get_grain_size(count);
+        uint32_t chunkCount = count / grain + (count % grain != 0);
+        if( chunkCount <= 1 )
+        {
+            if( count > 0 )
+            {
+                fn(DispatchRange{ 0u, count });
+            }
+            return;
+        }
+
+        dispatch_and_wait(chunkCount, 1, [&](DispatchState state)
+            {
+                uint32_t begin = state.jobIndex * grain;
+                fn(DispatchRange{ begin, std::min(begin + grain, count) });
+            });
+    }
+
+    // Calls fn(const DispatchRange3d&) for boxes of up to grain locations covering range and waits for all of
+    // them. Zero grain components are taken from get_grain_size. Block locations are worked out once per box,
+    // the callback loops over its own box.
+    template<typename Fn>
+    static void parallel_for(const DispatchRange3d& range, glm::uvec3 grain, const Fn& fn)
+    {
+        if( range.empty() )
+        {
+            return;
+        }
+
+        glm::uvec3 size = range.size();
+        if( glm::any(glm::equal(grain, glm::uvec3(0u))) )
+        {
+            glm::uvec3 automatic = get_grain_size(range);
+            grain = { grain.x ? grain.x : automatic.x, grain.y ? grain.y : automatic.y, grain.z ? grain.z : automatic.z };
+        }
+
+        glm::uvec3 blocks = (size + grain - 1u) / grain;
+        uint32_t blockCount = blocks.x * blocks.y * blocks.z;
+        if( blockCount == 1 )
+        {
+            fn(range);
+            return;
+        }
+
+        dispatch_and_wait(blockCount, 1, [&](DispatchState state)
+            {
+                glm::uvec3 block{ state.jobIndex % blocks.x, (state.jobIndex / blocks.x) % blocks.y, state.jobIndex / (blocks.x * blocks.y) };
+                DispatchRange3d sub;
+                sub.begin = range.begin + block * grain;
+                sub.end = glm::min(sub.begin + grain, range.end);
+                fn(sub);
+            });
+    }
+
+    template<typename Fn>
+    static void parallel_for(const DispatchRange3d& range, const Fn& fn)
+    {
+        parallel_for(range, glm::uvec3(0u), fn);
+    }
+
+    // Calls fn(element) for every element of a random access range, grain elements per job as in parallel_for.
+    template<std::ranges::random_access_range Range, typename Fn>
+    static void parallel_for_each(Range&& items, uint32_t grain, const Fn& fn)
+    {
+        auto first = std::ranges::begin(items);
+        parallel_for(static_cast<uint32_t>(std::ranges::size(items)), grain, [&](DispatchRange range)
+            {
+                for( uint32_t i = range.begin; i < range.end; i++ )
+                {
+                    fn(first[i]);
+                }
+            });
+    }
 
-    [[nodiscard]] 
-    static std::atomic<uint32_t>* dispatch(uint32_t jobCount, uint32_t groupSize, const std::function<void(DispatchState)>& job);
-    static void dispatch_and_wait(uint32_t jobCount, uint32_t groupSize, const std::function<void(DispatchState)>& job);
+    // Folds [0, count) with fn(DispatchRange, T identity) -> T per sub-range and combine(T, T) -> T across them.
+    // Partial results are combined in index order on the calling thread, so the result does not depend on which
+    // thread ran which sub-range and combine only has to be associative.
+    template<typename T, typename Fn, typename Combine>
+    [[nodiscard]]
+    static T parallel_reduce(uint32_t count, uint32_t grain, const T& identity, const Fn& fn, const Combine& combine)
+    {
+        grain = grain ? grain : get_grain_size(count);
+        uint32_t chunkCount = count / grain + (count % grain != 0);
 
-    static void reset_counters();
+        std::vector<T> partials(chunkCount, identity);
+        parallel_for(count, grain, [&](DispatchRange range)
+            {
+                partials[range.begin / grain] = fn(range, identity);
+            });
+
+        T retval = identity;
+        for( const T& partial : partials )
+        {
+            retval = combine(retval, partial);
+        }
+        return retval;
+    }
+
+    // Exclusive scan, output[i] is input[0] to input[i - 1] folded with combine starting from identity. Returns
+    // the fold of the whole input. The sub-range totals are folded first, then every sub-range writes its own
+    // prefixes starting from the total of the ones before it. output may be input.
+    template<typename T, typename Combine>
+    static T parallel_scan(std::span<const std::type_identity_t<T>> input, std::span<std::type_identity_t<T>> output,
+                           uint32_t grain, const T& identity, const Combine& combine)
+    {
+        TRAP_LT(output.size(), input.size(), "Scan output is smaller than its input.");
+
+        uint32_t count = static_cast<uint32_t>(input.size());
+        grain = grain ? grain : get_grain_size(count);
+
+        std::vector<T> offsets(count / grain + (count % grain != 0), identity);
+        parallel_for(count, grain, [&](DispatchRange range)
+            {
+                T sum = identity;
+                for( uint32_t i = range.begin; i < range.end; i++ )
+                {
+                    sum = combine(sum, input[i]);
+                }
+                offsets[range.begin / grain] = sum;
+            });
+
+        T total = identity;
+        for( T& offset : offsets )
+        {
+            T sum = offset;
+            offset = total;
+            total = combine(total, sum);
+        }
+
+        parallel_for(count, grain, [&](DispatchRange range)
+            {
+                T running = offsets[range.begin / grain];
+                for( uint32_t i = range.begin; i < range.end; i++ )
+                {
+                    T value = input[i];
+                    output[i] = running;
+                    running = combine(running, value);
+                }
+            });
+
+        return total;
+    }
+
+    // Waits for handle to be done, running pending jobs other than background ones on the calling thread in the
+    // meantime.
+    static void wait(const JobHandle& handle);
 
     static jclog::Log& get_thread_log(std::thread::id tid = std::this_thread::get_id());
 
+    // Runs one pending job other than a background one on the calling thread, or gives up its time slice if
+    // there is none.
     static void poll();
 private:
-    static std::atomic<uint32_t>* request_atomic_counter(uint32_t initialValue);
+    // Submits job once every dependency is done. A counter holding one for every dependency plus one for the
+    // submission gates the job, each dependency decrements it when it finishes.
+    static void submit_after(Job* job, std::span<const JobHandle> dependencies);
+
+    // Takes amount off counter. The call which takes it to zero submits the gated job, decrements the waiters and
+    // drops the reference of the outstanding work.
+    static void complete(JobCounter& counter, uint32_t amount);
+
+    // Plain counters are used by the waiting variants which keep the counter on their own stack.
+    static void complete(std::atomic<uint32_t>& counter, uint32_t amount)
+    {
+        counter.fetch_sub(amount);
+    }
+
+    template<typename Counter, typename Fn>
+    static void submit_groups(Counter& counter, uint32_t jobCount, uint32_t groupSize, const Fn& job)
+    {
+        if( jobCount == 0 || groupSize == 0 )
+        {
+            complete(counter, jobCount);
+            return;
+        }
+
+        uint32_t groupCount = (jobCount + groupSize - 1) / groupSize;
+        for( uint32_t i = 0; i < groupCount; i++ )
+        {
+            instance().m_scheduler->submit([&counter, &job, i, groupSize, jobCount]{
+                DispatchState state{ };
+                state.groupIndex = i;
+
+                uint32_t groupStartIndex = groupSize * i;
+                uint32_t groupEndIndex = std::min(groupStartIndex + groupSize, jobCount);
+
+                for( uint32_t jobGroupIndex = 0; jobGroupIndex < groupEndIndex - groupStartIndex; jobGroupIndex++ )
+                {
+                    state.jobGroupIndex = jobGroupIndex;
+                    state.jobIndex = groupStartIndex + jobGroupIndex;
+
+                    job(state);
+                }
+
+                // Once per group, the waiters only look for zero.
+                complete(counter, groupEndIndex - groupStartIndex);
+            });
+        }
+    }
+
+    static void wait(const std::atomic<uint32_t>& counter);
 private:
+    // Sub-ranges per thread picked by get_grain_size.
+    static constexpr size_t s_chunksPerThread = 4;
+
     static JobDispatch& instance();
     static JobDispatch* m_instance;
 private:
-    threadsafe::Queue<std::function<void()>, 256> m_jobPool{ };
-    std::vector<WorkerInfo> m_workers{ };
-
-    std::mutex m_wakeMutex;
-    std::condition_variable m_wakeCondition;
-
-    std::unordered_set<std::atomic<uint32_t>*> m_counters{ };
+    std::unique_ptr<JobScheduler> m_scheduler;
 
     std::unordered_map<std::thread::id, jclog::Log> m_threadLogs;
 };
\ No newline at end of file
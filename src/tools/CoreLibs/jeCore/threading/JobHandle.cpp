@@ -0,0 +1,118 @@
+#include "JobHandle.h"
+
+#include <deque>
+#include <utility>
+
+// Counters are created far less often than jobs, once per submission rather than per group, so one lock
+// guards the pool. The deque keeps every counter ever created at a stable address.
+struct JobCounterPool
+{
+    std::mutex mutex;
+    std::deque<JobCounter> counters;
+    std::vector<JobCounter*> free;
+};
+
+// Never destroyed, like the job pools, workers can still release counters while the process exits.
+static JobCounterPool& counter_pool()
+{
+    static JobCounterPool* pool = new JobCounterPool();
+    return *pool;
+}
+
+JobCounter* JobCounter::create(uint32_t value)
+{
+    JobCounterPool& pool = counter_pool();
+    JobCounter* retval{ nullptr };
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        if( pool.free.empty() )
+        {
+            retval = &pool.counters.emplace_back();
+        }
+        else
+        {
+            retval = pool.free.back();
+            pool.free.pop_back();
+        }
+    }
+
+    // Waiters keep their capacity between uses.
+    retval->value.store(value, std::memory_order_relaxed);
+    retval->references.store(1u, std::memory_order_relaxed);
+    retval->gatedJob = nullptr;
+    retval->finished = false;
+    retval->waiters.clear();
+    return retval;
+}
+
+void JobCounter::add_reference()
+{
+    references.fetch_add(1u, std::memory_order_relaxed);
+}
+
+void JobCounter::release()
+{
+    if( references.fetch_sub(1u, std::memory_order_acq_rel) == 1u )
+    {
+        JobCounterPool& pool = counter_pool();
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.free.push_back(this);
+    }
+}
+
+JobHandle::JobHandle(JobCounter* counter) :
+    m_counter(counter)
+{
+    if( m_counter )
+    {
+        m_counter->add_reference();
+    }
+}
+
+JobHandle::JobHandle(const JobHandle& other) :
+    JobHandle(other.m_counter)
+{ }
+
+JobHandle::JobHandle(JobHandle&& other) noexcept :
+    m_counter(std::exchange(other.m_counter, nullptr))
+{ }
+
+JobHandle& JobHandle::operator=(const JobHandle& other)
+{
+    if( this != &other )
+    {
+        *this = JobHandle(other);
+    }
+    return *this;
+}
+
+JobHandle& JobHandle::operator=(JobHandle&& other) noexcept
+{
+    if( this != &other )
+    {
+        if( m_counter )
+        {
+            m_counter->release();
+        }
+        m_counter = std::exchange(other.m_counter, nullptr);
+    }
+    return *this;
+}
+
+JobHandle::~JobHandle()
+{
+    if( m_counter )
+    {
+        m_counter->release();
+    }
+}
+
+bool JobHandle::is_done() const
+{
+    return !m_counter || m_counter->value.load(std::memory_order_acquire) == 0u;
+}
+
+bool JobHandle::is_valid() const
+{
+    return m_counter != nullptr;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+class Job;
+
+// Completion counter shared by the handles of one submission. value counts the work still outstanding, once it
+// drops to zero the gated job is submitted and every waiter is decremented in turn, which is how jobs wait on
+// their dependencies. Counters are pooled and go back to the pool when the last reference is released, the
+// outstanding work holds one reference until value reaches zero and every JobHandle holds another.
+struct JobCounter
+{
+    // Takes a counter from the pool holding value and the reference of the outstanding work.
+    static JobCounter* create(uint32_t value);
+
+    void add_reference();
+    void release();
+
+    std::atomic<uint32_t> value{ 0 };
+    std::atomic<uint32_t> references{ 0 };
+
+    // Submitted once value drops to zero.
+    Job* gatedJob{ nullptr };
+
+    // Counters to decrement once value drops to zero. Added under waiterMutex until finished is set, after that
+    // only the thread which finished the counter reads them.
+    std::mutex waiterMutex;
+    bool finished{ false };
+    std::vector<JobCounter*> waiters;
+};
+
+// Reference to the completion of submitted work, see JobDispatch. Handles are cheap to copy and can be passed
+// as dependencies of later jobs. An empty handle counts as done.
+class JobHandle
+{
+public:
+    JobHandle() = default;
+    JobHandle(const JobHandle& other);
+    JobHandle(JobHandle&& other) noexcept;
+    JobHandle& operator=(const JobHandle& other);
+    JobHandle& operator=(JobHandle&& other) noexcept;
+
+    ~JobHandle();
+
+    // Whether every job counted by the handle finished running.
+    bool is_done() const;
+    bool is_valid() const;
+private:
+    friend class JobDispatch;
+
+    // Adds a reference to counter.
+    explicit JobHandle(JobCounter* counter);
+
+    JobCounter* m_counter{ nullptr };
+};
@@ -0,0 +1,261 @@
+#include "JobScheduler.h"
+
+#include "threading.h"
+
+// Job records created by one thread. Only the owning thread takes records, any thread gives them back, records
+// run by the owner go straight onto its free list while the rest are pushed onto returned. The owner takes all
+// of returned at once so the pushes never race a pop.
+struct JobPool
+{
+    static constexpr size_t s_blockSize = 64;
+
+    Job* free{ nullptr };
+    std::atomic<Job*> returned{ nullptr };
+    std::vector<std::unique_ptr<Job[]>> blocks;
+};
+
+// Pools outlive their threads on purpose, a record can still be running on another thread when its creator exits.
+static thread_local JobPool* s_jobPool{ nullptr };
+
+// Scheduler and index of the worker running on this thread, jobs it submits go onto its own deque.
+static thread_local JobScheduler* s_currentScheduler{ nullptr };
+static thread_local uint32_t s_currentWorker{ 0 };
+
+Job* Job::allocate()
+{
+    if( !s_jobPool )
+    {
+        s_jobPool = new JobPool();
+    }
+    JobPool& pool = *s_jobPool;
+
+    if( !pool.free )
+    {
+        pool.free = pool.returned.exchange(nullptr, std::memory_order_acquire);
+    }
+
+    if( !pool.free )
+    {
+        std::unique_ptr<Job[]> block = std::make_unique<Job[]>(JobPool::s_blockSize);
+        for( size_t i = 0; i < JobPool::s_blockSize; i++ )
+        {
+            block[i].m_pool = &pool;
+            block[i].m_next = i + 1 < JobPool::s_blockSize ? &block[i + 1] : nullptr;
+        }
+        pool.free = block.get();
+        pool.blocks.push_back(std::move(block));
+    }
+
+    Job* retval = pool.free;
+    pool.free = retval->m_next;
+    return retval;
+}
+
+void Job::release(Job* job)
+{
+    JobPool& pool = *job->m_pool;
+    if( &pool == s_jobPool )
+    {
+        job->m_next = pool.free;
+        pool.free = job;
+        return;
+    }
+
+    Job* head = pool.returned.load(std::memory_order_relaxed);
+    do
+    {
+        job->m_next = head;
+    } while( !pool.returned.compare_exchange_weak(head, job, std::memory_order_release, std::memory_order_relaxed) );
+}
+
+JobScheduler::JobScheduler(uint32_t workerCount, const std::string& name)
+{
+    m_workers.resize(workerCount);
+    for( std::unique_ptr<Worker>& worker : m_workers )
+    {
+        worker = std::make_unique<Worker>();
+    }
+
+    // Workers steal from each other so every deque has to exist before the first one starts.
+    for( uint32_t i = 0; i < workerCount; i++ )
+    {
+        m_workers[i]->thread = request_thread(std::format("{}_{}", name, i), [this, i]{
+                run_worker(i);
+        });
+    }
+}
+
+JobScheduler::~JobScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_stopping.store(true);
+    }
+    m_sleepCondition.notify_all();
+
+    for( std::unique_ptr<Worker>& worker : m_workers )
+    {
+        worker->thread.join();
+    }
+}
+
+size_t JobScheduler::get_worker_count() const
+{
+    return m_workers.size();
+}
+
+std::thread::id JobScheduler::get_worker_id(uint32_t worker) const
+{
+    return m_workers.at(worker)->thread.get_id();
+}
+
+void JobScheduler::submit(Job* job, JobPriority priority)
+{
+    // Counted before it is visible so a worker taking it never sees the count drop below zero.
+    m_pendingCount.fetch_add(1);
+
+    if( priority == JobPriority::BACKGROUND )
+    {
+        m_background.push(job);
+    }
+    else if( s_currentScheduler == this )
+    {
+        m_workers[s_currentWorker]->jobs.push(job);
+    }
+    else
+    {
+        m_injection.push(job);
+    }
+
+    // Pairs with the sleeping count being raised before a worker checks the pending count, either the worker
+    // sees this job or this sees the worker. Locking orders the notify after the worker started waiting.
+    if( m_sleepingCount.load() > 0 )
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_sleepMutex);
+        }
+        m_sleepCondition.notify_one();
+    }
+}
+
+bool JobScheduler::run_pending_job()
+{
+    uint32_t index = s_currentScheduler == this ? s_currentWorker : static_cast<uint32_t>(m_workers.size());
+    if( Job* job = take_job(index, false) )
+    {
+        job->run();
+        return true;
+    }
+    return false;
+}
+
+void JobScheduler::run_worker(uint32_t index)
+{
+    s_currentScheduler = this;
+    s_currentWorker = index;
+
+    uint32_t failedAttempts{ 0 };
+    while( true )
+    {
+        if( Job* job = take_job(index, true) )
+        {
+            job->run();
+            failedAttempts = 0;
+            continue;
+        }
+
+        if( ++failedAttempts < s_spinCount )
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        failedAttempts = 0;
+
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        m_sleepingCount.fetch_add(1);
+        m_sleepCondition.wait(lock, [this]{
+                return m_pendingCount.load() > 0 || m_stopping.load();
+        });
+        m_sleepingCount.fetch_sub(1);
+
+        if( m_stopping.load() && m_pendingCount.load() <= 0 )
+        {
+            break;
+        }
+    }
+
+    s_currentScheduler = nullptr;
+}
+
+Job* JobScheduler::take_job(uint32_t index, bool background)
+{
+    Job* retval{ nullptr };
+    const uint32_t workerCount = static_cast<uint32_t>(m_workers.size());
+
+    if( index < workerCount && m_workers[index]->jobs.pop(&retval) )
+    {
+        m_pendingCount.fetch_sub(1);
+        return retval;
+    }
+
+    if( (retval = m_injection.pop()) )
+    {
+        m_pendingCount.fetch_sub(1);
+        return retval;
+    }
+
+    // Starting after the caller spreads the thieves over the victims.
+    for( uint32_t offset = 1; offset <= workerCount; offset++ )
+    {
+        uint32_t victim = (index + offset) % workerCount;
+        if( victim != index && m_workers[victim]->jobs.steal(&retval) )
+        {
+            m_pendingCount.fetch_sub(1);
+            return retval;
+        }
+    }
+
+    if( background && (retval = m_background.pop()) )
+    {
+        m_pendingCount.fetch_sub(1);
+        return retval;
+    }
+
+    return nullptr;
+}
+
+void JobScheduler::SharedQueue::push(Job* job)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t size = count.load(std::memory_order_relaxed);
+    if( size == jobs.size() )
+    {
+        std::rotate(jobs.begin(), jobs.begin() + first, jobs.end());
+        jobs.resize(jobs.size() * 2);
+        first = 0;
+    }
+
+    jobs[(first + size) % jobs.size()] = job;
+    count.store(size + 1);
+}
+
+Job* JobScheduler::SharedQueue::pop()
+{
+    // Skips the lock while empty, the common case for most callers.
+    if( count.load(std::memory_order_relaxed) == 0 )
+    {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t size = count.load(std::memory_order_relaxed);
+    if( size == 0 )
+    {
+        return nullptr;
+    }
+
+    Job* retval = jobs[first];
+    first = (first + 1) % jobs.size();
+    count.store(size - 1);
+    return retval;
+}
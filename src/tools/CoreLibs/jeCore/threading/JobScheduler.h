@@ -0,0 +1,154 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <thread>
+
+#include "WorkStealingDeque.h"
+
+struct JobPool;
+
+// Fixed size record of a submitted callable. Callables up to s_storageSize bytes are stored inline, larger
+// ones are moved to the heap. Records come from a pool per thread and go back to the pool of the thread which
+// created them once run, so submitting allocates nothing after a thread's first few jobs.
+class alignas(64) Job
+{
+public:
+    template<typename Fn>
+    static Job* create(Fn&& fn)
+    {
+        using Callable = std::decay_t<Fn>;
+
+        Job* job = allocate();
+        if constexpr( sizeof(Callable) <= s_storageSize && alignof(Callable) <= alignof(std::max_align_t) )
+        {
+            new (job->m_storage) Callable(std::forward<Fn>(fn));
+            job->m_invoke = [](Job& self)
+                {
+                    Callable& callable = *std::launder(reinterpret_cast<Callable*>(self.m_storage));
+                    callable();
+                    callable.~Callable();
+                };
+        }
+        else
+        {
+            new (job->m_storage) Callable*(new Callable(std::forward<Fn>(fn)));
+            job->m_invoke = [](Job& self)
+                {
+                    Callable* callable = *std::launder(reinterpret_cast<Callable**>(self.m_storage));
+                    (*callable)();
+                    delete callable;
+                };
+        }
+        return job;
+    }
+
+    // Runs the callable and returns the record to its pool, the record must not be used afterwards.
+    inline void run()
+    {
+        m_invoke(*this);
+        release(this);
+    }
+private:
+    friend struct JobPool;
+
+    static Job* allocate();
+    static void release(Job* job);
+private:
+    static constexpr size_t s_storageSize = 48;
+
+    union
+    {
+        void (*m_invoke)(Job& self);
+        // Next free record while the record sits in a pool.
+        Job* m_next;
+    };
+    JobPool* m_pool{ nullptr };
+    alignas(std::max_align_t) std::byte m_storage[s_storageSize];
+};
+
+static_assert(sizeof(Job) == 64, "Job records are meant to fill a single cache line.");
+
+enum class JobPriority
+{
+    NORMAL,
+    // Long running work such as remeshes and disk IO. Only workers with nothing else to run take it and threads
+    // helping out while they wait never do, so a wait is never stuck behind it.
+    BACKGROUND,
+};
+
+// Work-stealing pool of worker threads. Every worker owns a deque, jobs submitted from a worker go onto its own
+// deque and are run newest first so nested work stays in that worker's cache, workers whose deque ran dry steal
+// the oldest jobs of the others. Jobs submitted from any other thread go through a shared injection queue and
+// background jobs through a queue of their own which is looked at last.
+// Submission never waits for space, workers with nothing left to run or steal sleep until the next submit.
+class JobScheduler
+{
+public:
+    JobScheduler(uint32_t workerCount, const std::string& name);
+    JobScheduler(JobScheduler&&) = delete;
+    JobScheduler(const JobScheduler&) = delete;
+    JobScheduler& operator=(JobScheduler&&) = delete;
+    JobScheduler& operator=(const JobScheduler&) = delete;
+
+    // Runs every job submitted so far, then stops the workers.
+    ~JobScheduler();
+
+    size_t get_worker_count() const;
+    std::thread::id get_worker_id(uint32_t worker) const;
+
+    // Queues a copy of fn, stored in a Job record rather than behind std::function.
+    template<typename Fn>
+    inline void submit(Fn&& fn)
+    {
+        submit(Job::create(std::forward<Fn>(fn)));
+    }
+
+    void submit(Job* job, JobPriority priority = JobPriority::NORMAL);
+
+    // Takes a pending job other than a background one and runs it on the calling thread, false if there was
+    // nothing to take. Workers look at their own deque first so a worker waiting on work it just submitted runs
+    // that work itself.
+    bool run_pending_job();
+private:
+    struct Worker
+    {
+        threadsafe::WorkStealingDeque<Job*> jobs;
+        std::thread thread;
+    };
+
+    // Ring buffer which doubles when full, first holds the oldest job.
+    struct SharedQueue
+    {
+        void push(Job* job);
+        Job* pop();
+
+        std::mutex mutex;
+        std::vector<Job*> jobs{ std::vector<Job*>(256) };
+        size_t first{ 0 };
+        std::atomic<size_t> count{ 0 };
+    };
+
+    void run_worker(uint32_t index);
+
+    // Own deque first, then the injection queue, then the other workers' deques and with background set the
+    // background queue last. index is the caller's worker or get_worker_count() for any other thread.
+    Job* take_job(uint32_t index, bool background);
+private:
+    // Attempts to find work before a worker goes to sleep, waking costs far more than a few failed steals.
+    static constexpr uint32_t s_spinCount = 64;
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+
+    SharedQueue m_injection;
+    SharedQueue m_background;
+
+    // Jobs submitted and not yet taken by any thread, workers sleep while it is zero.
+    std::atomic<int64_t> m_pendingCount{ 0 };
+    std::atomic<uint32_t> m_sleepingCount{ 0 };
+    std::mutex m_sleepMutex;
+    std::condition_variable m_sleepCondition;
+    std::atomic<bool> m_stopping{ false };
+};
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace threadsafe
+{
+
+// Chase-Lev deque, after "Correct and Efficient Work-Stealing for Weak Memory Models" (Le et al. 2013). The
+// owning thread pushes and pops at the bottom without locking, any other thread steals from the top. The
+// buffer grows instead of rejecting a push, buffers it outgrew are kept until the deque is destroyed since a
+// thief may still be reading from one. T is copied through atomics so it has to be trivially copyable,
+// usually a pointer.
+template<typename T>
+class WorkStealingDeque
+{
+public:
+    // capacity is a power of two, doubled whenever a push finds the buffer full.
+    explicit WorkStealingDeque(int64_t capacity = 256)
+    {
+        TRAP_LE(capacity, 0, "Capacity must be greater than zero.");
+        TRAP_NEQ(capacity & (capacity - 1), 0, "Capacity must be a power of two.");
+
+        m_buffers.push_back(std::make_unique<Buffer>(capacity));
+        m_buffer.store(m_buffers.back().get(), std::memory_order_relaxed);
+    }
+
+    WorkStealingDeque(WorkStealingDeque&&) = delete;
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    WorkStealingDeque& operator=(WorkStealingDeque&&) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    // Owner only.
+    inline void push(T item)
+    {
+        int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+        int64_t top = m_top.load(std::memory_order_acquire);
+        Buffer* buffer = m_buffer.load(std::memory_order_relaxed);
+
+        if( bottom - top > buffer->capacity - 1 )
+        {
+            buffer = grow(buffer, top, bottom);
+        }
+
+        buffer->put(bottom, item);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_bottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+
+    // Owner only, takes the item pushed last.
+    inline bool pop(T* item)
+    {
+        int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+        Buffer* buffer = m_buffer.load(std::memory_order_relaxed);
+        m_bottom.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t top = m_top.load(std::memory_order_relaxed);
+
+        if( top > bottom )
+        {
+            m_bottom.store(bottom + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        *item = buffer->get(bottom);
+        if( top == bottom )
+        {
+            // Last item, race the thieves for it.
+            bool won = m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            m_bottom.store(bottom + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    // Any thread, takes the item pushed first. Fails when empty or when another thread took the item first.
+    inline bool steal(T* item)
+    {
+        int64_t top = m_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t bottom = m_bottom.load(std::memory_order_acquire);
+
+        if( top >= bottom )
+        {
+            return false;
+        }
+
+        Buffer* buffer = m_buffer.load(std::memory_order_acquire);
+        T stolen = buffer->get(top);
+        if( !m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed) )
+        {
+            return false;
+        }
+
+        *item = stolen;
+        return true;
+    }
+
+    // Approximate when other threads are pushing or stealing.
+    inline bool empty() const
+    {
+        return m_bottom.load(std::memory_order_relaxed) <= m_top.load(std::memory_order_relaxed);
+    }
+private:
+    struct Buffer
+    {
+        explicit Buffer(int64_t capacity) :
+            capacity(capacity),
+            items(std::make_unique<std::atomic<T>[]>(capacity))
+        { }
+
+        inline T get(int64_t index) const
+        {
+            return items[index & (capacity - 1)].load(std::memory_order_relaxed);
+        }
+
+        inline void put(int64_t index, T item)
+        {
+            items[index & (capacity - 1)].store(item, std::memory_order_relaxed);
+        }
+
+        const int64_t capacity;
+        std::unique_ptr<std::atomic<T>[]> items;
+    };
+
+    inline Buffer* grow(Buffer* buffer, int64_t top, int64_t bottom)
+    {
+        std::unique_ptr<Buffer> grown = std::make_unique<Buffer>(buffer->capacity * 2);
+        for( int64_t i = top; i < bottom; i++ )
+        {
+            grown->put(i, buffer->get(i));
+        }
+
+        Buffer* retval = grown.get();
+        m_buffers.push_back(std::move(grown));
+        m_buffer.store(retval, std::memory_order_release);
+        return retval;
+    }
+private:
+    static_assert(std::is_trivially_copyable_v<T>, "Deque items are copied through atomics.");
+
+    // Top only grows, on steals and on pops of the last item. Bottom grows on pushes and is lowered by pops.
+    alignas(64) std::atomic<int64_t> m_top{ 0 };
+    alignas(64) std::atomic<int64_t> m_bottom{ 0 };
+    alignas(64) std::atomic<Buffer*> m_buffer{ nullptr };
+    // Owner only, every buffer ever used.
+    std::vector<std::unique_ptr<Buffer>> m_buffers;
+};
+
+} // threadsafe
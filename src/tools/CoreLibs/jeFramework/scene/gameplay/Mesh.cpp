@@ -150,16 +150,34 @@ void Mesh::recalculate_normals()
         return;
     }
 
+    // Vertices can be shared between triangles so accumulate the area weighted face normals
+    // and normalize once everything has contributed.
+    std::vector<Vertex>& vertices = m_vertices.at(0);
+    for( Vertex& vertex : vertices )
+    {
+        vertex.normal = { 0.f, 0.f, 0.f };
+    }
+
     for( size_t i = 0; i < m_indices.size() - 2u; i+=3 )
     {
-        Vertex a = get_vertices(0).at(m_indices.at(i));
-        Vertex b = get_vertices(0).at(m_indices.at(i+1));
-        Vertex c = get_vertices(0).at(m_indices.at(i+2));
+        Vertex& a = vertices.at(m_indices.at(i));
+        Vertex& b = vertices.at(m_indices.at(i+1));
+        Vertex& c = vertices.at(m_indices.at(i+2));
 
         glm::vec3 cross = glm::cross(b.position - a.position, c.position - a.position);
-        glm::vec3 normal = glm::normalize(cross);
-        m_vertices.at(0).at(m_indices.at(i)).normal = normal;
-        m_vertices.at(0).at(m_indices.at(i+1)).normal = normal;
-        m_vertices.at(0).at(m_indices.at(i+2)).normal = normal;
+        a.normal += cross;
+        b.normal += cross;
+        c.normal += cross;
     }
+
+    for( Vertex& vertex : vertices )
+    {
+        float length = glm::length(vertex.normal);
+        if( length > 0.f )
+        {
+            vertex.normal /= length;
+        }
+    }
+
+    set_vertex_dirty(0);
 }
\ No newline at end of file